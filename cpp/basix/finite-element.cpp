@@ -6,6 +6,7 @@
 #include "brezzi-douglas-marini.h"
 #include "bubble.h"
 #include "crouzeix-raviart.h"
+#include "indexing.h"
 #include "lagrange.h"
 #include "nce-rtc.h"
 #include "nedelec.h"
@@ -15,7 +16,20 @@
 #include "serendipity.h"
 #include "version.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
 #include <numeric>
+#include <random>
+#include <tuple>
+#include <type_traits>
+#include <xtensor-blas/xblas.hpp>
 #include <xtensor-blas/xlinalg.hpp>
 #include <xtensor/xadapt.hpp>
 #include <xtensor/xbuilder.hpp>
@@ -27,6 +41,24 @@
 
 using namespace basix;
 
+// LAPACK routines. Fortran passes the length of each character
+// argument as a hidden trailing argument, which is a size_t with
+// gfortran 8 and later and with the other common compilers on 64-bit
+// platforms.
+extern "C"
+{
+  void dgetrf_(const int* m, const int* n, double* a, const int* lda,
+               int* ipiv, int* info);
+
+  void dgetrs_(const char* trans, const int* n, const int* nrhs,
+               const double* a, const int* lda, const int* ipiv, double* b,
+               const int* ldb, int* info, std::size_t trans_len);
+
+  void dgecon_(const char* norm, const int* n, const double* a,
+               const int* lda, const double* anorm, double* rcond,
+               double* work, int* iwork, int* info, std::size_t norm_len);
+}
+
 namespace
 {
 constexpr int compute_value_size(maps::type map_type, int dim)
@@ -72,8 +104,459 @@ constexpr int num_transformations(cell::type cell_type)
     throw std::runtime_error("Cell type not yet supported");
   }
 }
+//-----------------------------------------------------------------------------
+// Number of points tabulated at once by FiniteElement::tabulate. Large
+// point sets are split into tiles of this size so that the polyset
+// table for a tile stays in cache. Tiles are also the unit of work
+// when tabulating with several threads. This must be a multiple of
+// layout::block_size.
+constexpr std::size_t tabulate_tile_size = 256;
+static_assert(tabulate_tile_size % layout::block_size == 0);
+
+// Number of cells interpolated at once by
+// FiniteElement::interpolate_batch. The pulled back values of a block
+// of cells are multiplied by the interpolation matrix in one product.
+constexpr std::size_t interpolate_block_size = 256;
+//-----------------------------------------------------------------------------
+// Compute the row-major matrix product C = A B, where A has shape (m,
+// k) and B has shape (k, n). All arrays are contiguous.
+template <typename T>
+void dot_ab(std::size_t m, std::size_t n, std::size_t k, const T* A,
+            const T* B, T* C)
+{
+  cxxblas::gemm(cxxblas::StorageOrder::RowMajor, cxxblas::Transpose::NoTrans,
+                cxxblas::Transpose::NoTrans, static_cast<int>(m),
+                static_cast<int>(n), static_cast<int>(k), T(1), A,
+                static_cast<int>(k), B, static_cast<int>(n), T(0), C,
+                static_cast<int>(n));
+}
+//-----------------------------------------------------------------------------
+// Compute the row-major matrix product C = A B^T, where A has shape (m,
+// k) and B has shape (n, k), and the rows of A, B and C are lda, ldb
+// and ldc apart
+template <typename T>
+void dot_abt(std::size_t m, std::size_t n, std::size_t k, const T* A,
+             std::size_t lda, const T* B, std::size_t ldb, T* C,
+             std::size_t ldc)
+{
+  cxxblas::gemm(cxxblas::StorageOrder::RowMajor, cxxblas::Transpose::NoTrans,
+                cxxblas::Transpose::Trans, static_cast<int>(m),
+                static_cast<int>(n), static_cast<int>(k), T(1), A,
+                static_cast<int>(lda), B, static_cast<int>(ldb), T(0), C,
+                static_cast<int>(ldc));
+}
+//-----------------------------------------------------------------------------
+// Compute the row-major matrix product C = A B^T, where A has shape (m,
+// k) and B has shape (n, k). All arrays are contiguous.
+template <typename T>
+void dot_abt(std::size_t m, std::size_t n, std::size_t k, const T* A,
+             const T* B, T* C)
+{
+  dot_abt(m, n, k, A, k, B, k, C, n);
+}
+//-----------------------------------------------------------------------------
+// Apply a map with matrix A (if map_type is not identity) to the
+// values U, with shape (n, A.shape(1)), to give u = U A^T
+void apply_affine_map(maps::type map_type, const xt::xtensor<double, 2>& A,
+                      const xtl::span<const double>& U,
+                      const xtl::span<double>& u)
+{
+  if (map_type == maps::type::identity)
+  {
+    if (u.size() != U.size())
+      throw std::runtime_error("Data has the wrong size.");
+    std::copy(U.begin(), U.end(), u.begin());
+    return;
+  }
+
+  const std::size_t n = U.size() / A.shape(1);
+  if (U.size() != n * A.shape(1) or u.size() != n * A.shape(0))
+    throw std::runtime_error("Data has the wrong size.");
+  if (n > 0)
+    dot_abt(n, A.shape(0), A.shape(1), U.data(), A.data(), u.data());
+}
+//-----------------------------------------------------------------------------
+// Factorise the basis functions of an element on a quadrilateral or
+// hexahedron into products of one-dimensional functions. The expansion
+// coefficients have shape (dof, value * poly index), with the poly
+// index for the quadrilateral/hexahedron polyset being ordered with x
+// slowest. Returns the distinct 1D functions for each direction, as
+// coefficients of the 1D orthonormal basis, and the index of the 1D
+// function in each direction for each (dof, value component). An index
+// of -1 denotes a zero component. If the basis does not factorise, the
+// returned list of 1D functions is empty.
+std::pair<std::vector<xt::xtensor<double, 2>>, xt::xtensor<int, 3>>
+factorise_tensor_coefficients(const xt::xtensor<double, 2>& coeffs,
+                              std::size_t vs, std::size_t tdim, int degree)
+{
+  const double tol = 1.0e-10;
+  const std::size_t ndofs = coeffs.shape(0);
+  const std::size_t psize = coeffs.shape(1) / vs;
+
+  // Number of 1D polynomials in each direction. A quadrilateral is
+  // treated as a hexahedron with a single (constant) polynomial in z.
+  const std::size_t m = degree + 1;
+  const std::array<std::size_t, 3> n = {m, m, tdim == 3 ? m : 1};
+
+  std::vector<std::vector<std::vector<double>>> funcs(tdim);
+  xt::xtensor<int, 3> factors({ndofs, vs, tdim});
+  std::array<std::vector<double>, 3> f;
+  for (std::size_t i = 0; i < ndofs; ++i)
+  {
+    for (std::size_t j = 0; j < vs; ++j)
+    {
+      const double* c = coeffs.data() + i * coeffs.shape(1) + j * psize;
+
+      // Find the largest coefficient
+      std::size_t pivot = 0;
+      for (std::size_t p = 1; p < psize; ++p)
+        if (std::abs(c[p]) > std::abs(c[pivot]))
+          pivot = p;
+      const double cmax = std::abs(c[pivot]);
+      if (cmax < tol)
+      {
+        xt::view(factors, i, j, xt::all()) = -1;
+        continue;
+      }
+
+      // Build the 1D factors through the largest coefficient, with the
+      // scaling carried by the factor in x
+      const std::array<std::size_t, 3> q
+          = {pivot / (n[1] * n[2]), (pivot / n[2]) % n[1], pivot % n[2]};
+      for (std::size_t d = 0; d < 3; ++d)
+        f[d].resize(n[d]);
+      for (std::size_t a = 0; a < n[0]; ++a)
+        f[0][a] = c[(a * n[1] + q[1]) * n[2] + q[2]];
+      for (std::size_t b = 0; b < n[1]; ++b)
+        f[1][b] = c[(q[0] * n[1] + b) * n[2] + q[2]] / c[pivot];
+      for (std::size_t k = 0; k < n[2]; ++k)
+        f[2][k] = c[(q[0] * n[1] + q[1]) * n[2] + k] / c[pivot];
+
+      // Check that the coefficients are the product of the factors
+      for (std::size_t a = 0; a < n[0]; ++a)
+        for (std::size_t b = 0; b < n[1]; ++b)
+          for (std::size_t k = 0; k < n[2]; ++k)
+          {
+            const double cf = f[0][a] * f[1][b] * f[2][k];
+            if (std::abs(c[(a * n[1] + b) * n[2] + k] - cf) > tol * cmax)
+              return {};
+          }
+
+      // Store the factors, re-using 1D functions that have already been
+      // found
+      for (std::size_t d = 0; d < tdim; ++d)
+      {
+        const double scale = std::max(
+            1.0, std::abs(*std::max_element(
+                     f[d].begin(), f[d].end(), [](double a, double b)
+                     { return std::abs(a) < std::abs(b); })));
+        auto it = std::find_if(
+            funcs[d].begin(), funcs[d].end(),
+            [&](const std::vector<double>& g)
+            {
+              for (std::size_t a = 0; a < g.size(); ++a)
+                if (std::abs(g[a] - f[d][a]) > tol * scale)
+                  return false;
+              return true;
+            });
+        factors(i, j, d) = std::distance(funcs[d].begin(), it);
+        if (it == funcs[d].end())
+          funcs[d].push_back(f[d]);
+      }
+    }
+  }
+
+  std::vector<xt::xtensor<double, 2>> factor_coeffs;
+  for (std::size_t d = 0; d < tdim; ++d)
+  {
+    xt::xtensor<double, 2> F({funcs[d].size(), n[d]});
+    for (std::size_t i = 0; i < funcs[d].size(); ++i)
+      for (std::size_t a = 0; a < n[d]; ++a)
+        F(i, a) = funcs[d][i][a];
+    factor_coeffs.push_back(std::move(F));
+  }
+
+  return {std::move(factor_coeffs), std::move(factors)};
+}
+//-----------------------------------------------------------------------------
+// Combine the base transformations T of an entity into a single
+// transformation for each orientation of the entity, indexed by the
+// orientation code used in the cell info. For an interval, code 1 is a
+// reversal. For a face, bit 0 of the code is a reflection and bits 1
+// and 2 are the number of rotations, which are applied after the
+// reflection. Returns the transformation and its inverse for each code.
+std::pair<std::vector<xt::xtensor<double, 2>>,
+          std::vector<xt::xtensor<double, 2>>>
+combine_entity_transformations(cell::type entity_type,
+                               const xt::xtensor<double, 3>& T)
+{
+  const std::size_t ndofs = T.shape(1);
+  const xt::xtensor<double, 2> I = xt::eye<double>(ndofs);
+  if (entity_type == cell::type::interval)
+  {
+    // A reversal is its own inverse
+    const xt::xtensor<double, 2> R = xt::view(T, 0, xt::all(), xt::all());
+    return {{I, R}, {I, R}};
+  }
+
+  // A reflection is its own inverse. For a quadrilateral face, R^4 = Id,
+  // so R^{-1} = R^3. For a triangular face, R^3 = Id, so R^{-1} = R^2.
+  const xt::xtensor<double, 2> R = xt::view(T, 0, xt::all(), xt::all());
+  const xt::xtensor<double, 2> F = xt::view(T, 1, xt::all(), xt::all());
+  xt::xtensor<double, 2> Rinv = I;
+  if (ndofs > 0)
+  {
+    Rinv = xt::linalg::dot(R, R);
+    if (entity_type == cell::type::quadrilateral)
+      Rinv = xt::linalg::dot(Rinv, R);
+  }
+
+  std::vector<xt::xtensor<double, 2>> M, Minv;
+  for (std::uint32_t code = 0; code < 8; ++code)
+  {
+    xt::xtensor<double, 2> m = (code & 1) ? F : I;
+    xt::xtensor<double, 2> minv = m;
+    for (std::uint32_t r = 0; ndofs > 0 and r < (code >> 1); ++r)
+    {
+      m = xt::linalg::dot(R, m);
+      minv = xt::linalg::dot(minv, Rinv);
+    }
+    M.push_back(std::move(m));
+    Minv.push_back(std::move(minv));
+  }
+
+  return {std::move(M), std::move(Minv)};
+}
+//-----------------------------------------------------------------------------
+// The index of an entity type in the tables of precomputed entity
+// transformations
+std::size_t etrans_type_index(cell::type entity_type)
+{
+  switch (entity_type)
+  {
+  case cell::type::interval:
+    return 0;
+  case cell::type::triangle:
+    return 1;
+  case cell::type::quadrilateral:
+    return 2;
+  default:
+    throw std::runtime_error("Unsupported entity type for transformations.");
+  }
+}
+//-----------------------------------------------------------------------------
+// Identifier and version of the binary format written by
+// FiniteElement::serialize. The version must be increased when the
+// format changes.
+constexpr std::array<char, 8> serialize_magic
+    = {'b', 'a', 's', 'i', 'x', 'f', 'e', '\0'};
+constexpr std::uint32_t serialize_version = 1;
+//-----------------------------------------------------------------------------
+// Append n values to a buffer
+template <typename T>
+void write_array(std::vector<char>& buffer, const T* data, std::size_t n)
+{
+  static_assert(std::is_trivially_copyable<T>::value);
+  const char* bytes = reinterpret_cast<const char*>(data);
+  buffer.insert(buffer.end(), bytes, bytes + n * sizeof(T));
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void write_value(std::vector<char>& buffer, T value)
+{
+  write_array(buffer, &value, 1);
+}
+//-----------------------------------------------------------------------------
+// Append the shape and the (row-major) data of an array to a buffer
+template <typename T, std::size_t N>
+void write_tensor(std::vector<char>& buffer, const xt::xtensor<T, N>& a)
+{
+  for (std::size_t i = 0; i < N; ++i)
+    write_value<std::uint64_t>(buffer, a.shape(i));
+  write_array(buffer, a.data(), a.size());
+}
+//-----------------------------------------------------------------------------
+// Read the values written by write_array, write_value and write_tensor
+// from a buffer, checking that the buffer is large enough
+class BufferReader
+{
+public:
+  explicit BufferReader(const xtl::span<const char>& data) : _data(data) {}
+
+  template <typename T>
+  void read_array(T* data, std::size_t n)
+  {
+    static_assert(std::is_trivially_copyable<T>::value);
+    if (n > (_data.size() - _pos) / sizeof(T))
+      throw std::runtime_error("Serialized element data is too short.");
+    std::memcpy(data, _data.data() + _pos, n * sizeof(T));
+    _pos += n * sizeof(T);
+  }
+
+  template <typename T>
+  T read_value()
+  {
+    T value;
+    read_array(&value, 1);
+    return value;
+  }
+
+  // Read the number of items in a list, where each item takes at least
+  // item_size bytes, before anything is allocated for the items
+  std::size_t read_count(std::size_t item_size)
+  {
+    const std::uint64_t n = read_value<std::uint64_t>();
+    if (n > (_data.size() - _pos) / item_size)
+      throw std::runtime_error("Serialized element data is too short.");
+    return n;
+  }
+
+  template <typename T, std::size_t N>
+  xt::xtensor<T, N> read_tensor()
+  {
+    std::array<std::size_t, N> shape;
+    std::size_t size = 1;
+    for (std::size_t i = 0; i < N; ++i)
+    {
+      shape[i] = read_value<std::uint64_t>();
+      if (shape[i] != 0
+          and size > (_data.size() - _pos) / sizeof(T) / shape[i])
+      {
+        throw std::runtime_error("Serialized element data is too short.");
+      }
+      size *= shape[i];
+    }
+
+    xt::xtensor<T, N> a(shape);
+    read_array(a.data(), a.size());
+    return a;
+  }
+
+  // Check that all the data has been read
+  bool finished() const { return _pos == _data.size(); }
+
+private:
+  xtl::span<const char> _data;
+  std::size_t _pos = 0;
+};
+//-----------------------------------------------------------------------------
+// File in the cache directory that stores an element
+std::string element_cache_file(const std::string& directory,
+                               element::family family, cell::type cell,
+                               int degree)
+{
+  return directory + "/basix-" + basix::version() + "-"
+         + std::to_string(static_cast<int>(family)) + "-"
+         + std::to_string(static_cast<int>(cell)) + "-"
+         + std::to_string(degree) + ".bin";
+}
+//-----------------------------------------------------------------------------
+// Read an element from a file in the cache directory. Returns nullptr
+// if the file does not exist or cannot be read.
+std::shared_ptr<const FiniteElement> read_element(const std::string& filename)
+{
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file)
+    return nullptr;
+  const std::streamoff size = file.tellg();
+  if (size < 0)
+    return nullptr;
+  std::vector<char> data(size);
+  file.seekg(0);
+  if (!file.read(data.data(), data.size()))
+    return nullptr;
+
+  try
+  {
+    return std::make_shared<const FiniteElement>(deserialize_element(
+        xtl::span<const char>(data.data(), data.size())));
+  }
+  catch (const std::exception&)
+  {
+    return nullptr;
+  }
+}
+//-----------------------------------------------------------------------------
+// Write an element to a file in the cache directory. The element is
+// written to a temporary file which is then renamed, so that other
+// processes never read a partly written file. Failure to write the
+// file is ignored.
+void write_element(const std::string& filename, const FiniteElement& element)
+{
+  std::random_device rd;
+  const std::string tmp_filename = filename + "." + std::to_string(rd());
+  {
+    std::ofstream file(tmp_filename, std::ios::binary);
+    if (!file)
+      return;
+    const std::vector<char> data = element.serialize();
+    if (!file.write(data.data(), data.size()))
+    {
+      file.close();
+      std::remove(tmp_filename.c_str());
+      return;
+    }
+  }
+
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    std::remove(tmp_filename.c_str());
+}
+//-----------------------------------------------------------------------------
+// Elements created by basix::create_element_cached. An element that is
+// being created is stored as a future, so other threads that request
+// the same element wait for it rather than creating it again.
+struct ElementCache
+{
+  // A cached element, and the address of the promise of the call that
+  // creates it. The address identifies the entry of a call, which may
+  // have been replaced by another call's entry after the cache was
+  // cleared.
+  struct Entry
+  {
+    std::shared_future<std::shared_ptr<const FiniteElement>> element;
+    const void* owner;
+  };
+
+  std::mutex mutex;
+  std::map<std::tuple<element::family, cell::type, int>, Entry> elements;
+  std::size_t hits = 0;
+  std::size_t misses = 0;
+  std::size_t disk_hits = 0;
+
+  // Directory in which elements are stored. Not used if empty.
+  std::string directory;
+};
+//-----------------------------------------------------------------------------
+ElementCache& element_cache()
+{
+  static ElementCache cache;
+  return cache;
+}
 } // namespace
 //-----------------------------------------------------------------------------
+FiniteElement::DofTransformationCache::DofTransformationCache(
+    const DofTransformationCache& cache)
+{
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  size = cache.size;
+  matrices = cache.matrices;
+  order = cache.order;
+}
+//-----------------------------------------------------------------------------
+FiniteElement::DofTransformationCache&
+FiniteElement::DofTransformationCache::operator=(
+    const DofTransformationCache& cache)
+{
+  if (this != &cache)
+  {
+    std::scoped_lock lock(mutex, cache.mutex);
+    size = cache.size;
+    matrices = cache.matrices;
+    order = cache.order;
+  }
+  return *this;
+}
+//-----------------------------------------------------------------------------
 basix::FiniteElement basix::create_element(std::string family, std::string cell,
                                            int degree)
 {
@@ -149,6 +632,263 @@ basix::FiniteElement basix::create_element(element::family family,
   }
 }
 //-----------------------------------------------------------------------------
+std::shared_ptr<const FiniteElement>
+basix::create_element_cached(std::string family, std::string cell, int degree)
+{
+  return basix::create_element_cached(element::str_to_type(family),
+                                      cell::str_to_type(cell), degree);
+}
+//-----------------------------------------------------------------------------
+std::shared_ptr<const FiniteElement>
+basix::create_element_cached(element::family family, cell::type cell,
+                             int degree)
+{
+  ElementCache& cache = element_cache();
+  const std::tuple<element::family, cell::type, int> key(family, cell,
+                                                         degree);
+  std::promise<std::shared_ptr<const FiniteElement>> promise;
+  std::shared_future<std::shared_ptr<const FiniteElement>> element;
+  bool found = false;
+  std::string directory;
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (auto it = cache.elements.find(key); it != cache.elements.end())
+    {
+      ++cache.hits;
+      element = it->second.element;
+      found = true;
+    }
+    else
+    {
+      ++cache.misses;
+      element = promise.get_future().share();
+      cache.elements.emplace(key, ElementCache::Entry{element, &promise});
+      directory = cache.directory;
+    }
+  }
+
+  // The element is created without holding the lock, so that different
+  // elements can be created concurrently
+  if (!found)
+  {
+    try
+    {
+      std::shared_ptr<const FiniteElement> e;
+      const std::string filename
+          = directory.empty()
+                ? ""
+                : element_cache_file(directory, family, cell, degree);
+      if (!filename.empty())
+        e = read_element(filename);
+
+      if (e)
+      {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        ++cache.disk_hits;
+      }
+      else
+      {
+        e = std::make_shared<const FiniteElement>(
+            create_element(family, cell, degree));
+        if (!filename.empty())
+          write_element(filename, *e);
+      }
+
+      promise.set_value(e);
+    }
+    catch (...)
+    {
+      // Remove the failed entry so that a later call can try again,
+      // unless the cache has been cleared and another call has since
+      // added its own entry for this element
+      {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if (auto it = cache.elements.find(key);
+            it != cache.elements.end() and it->second.owner == &promise)
+          cache.elements.erase(it);
+      }
+      promise.set_exception(std::current_exception());
+    }
+  }
+
+  return element.get();
+}
+//-----------------------------------------------------------------------------
+ElementCacheStatistics basix::element_cache_statistics()
+{
+  ElementCache& cache = element_cache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  return {cache.hits, cache.misses, cache.elements.size(), cache.disk_hits};
+}
+//-----------------------------------------------------------------------------
+void basix::clear_element_cache()
+{
+  ElementCache& cache = element_cache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.elements.clear();
+  cache.hits = 0;
+  cache.misses = 0;
+  cache.disk_hits = 0;
+}
+//-----------------------------------------------------------------------------
+void basix::set_element_cache_directory(const std::string& directory)
+{
+  ElementCache& cache = element_cache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.directory = directory;
+}
+//-----------------------------------------------------------------------------
+FiniteElement basix::deserialize_element(const xtl::span<const char>& data)
+{
+  BufferReader reader(data);
+  std::array<char, 8> magic;
+  reader.read_array(magic.data(), magic.size());
+  if (magic != serialize_magic)
+    throw std::runtime_error("Data is not a serialized element.");
+  if (reader.read_value<std::uint32_t>() != serialize_version)
+    throw std::runtime_error("Unsupported serialized element version.");
+
+  const int family_index = reader.read_value<int>();
+  const int cell_index = reader.read_value<int>();
+  const int degree = reader.read_value<int>();
+  const int map_index = reader.read_value<int>();
+  if (family_index < 0
+      or family_index > static_cast<int>(element::family::Serendipity)
+      or cell_index < static_cast<int>(cell::type::interval)
+      or cell_index > static_cast<int>(cell::type::pyramid)
+      or map_index < 0
+      or map_index > static_cast<int>(maps::type::doubleContravariantPiola))
+  {
+    throw std::runtime_error("Serialized element data is inconsistent.");
+  }
+  const auto family = static_cast<element::family>(family_index);
+  const auto cell_type = static_cast<cell::type>(cell_index);
+  const auto map_type = static_cast<maps::type>(map_index);
+  const std::size_t tdim = cell::topological_dimension(cell_type);
+
+  // polyset::dim does not overflow an int for degrees up to 1000
+  if (degree < 0 or degree > 1000)
+    throw std::runtime_error("Serialized element data is inconsistent.");
+
+  std::vector<std::size_t> value_shape(
+      reader.read_count(sizeof(std::uint64_t)));
+  std::size_t value_size = 1;
+  for (std::size_t& v : value_shape)
+  {
+    v = reader.read_value<std::uint64_t>();
+    if (v == 0 or value_size > data.size() / v)
+      throw std::runtime_error("Serialized element data is inconsistent.");
+    value_size *= v;
+  }
+
+  // Check that the value size is the one the map acts on
+  if ((map_type == maps::type::covariantPiola
+       or map_type == maps::type::contravariantPiola)
+      and value_size != tdim)
+  {
+    throw std::runtime_error("Serialized element data is inconsistent.");
+  }
+  if ((map_type == maps::type::doubleCovariantPiola
+       or map_type == maps::type::doubleContravariantPiola)
+      and value_size != tdim * tdim)
+  {
+    throw std::runtime_error("Serialized element data is inconsistent.");
+  }
+
+  const xt::xtensor<double, 2> coeffs = reader.read_tensor<double, 2>();
+  if (coeffs.shape(1) != value_size * polyset::dim(cell_type, degree))
+    throw std::runtime_error("Serialized element data is inconsistent.");
+
+  // Each entity transformation takes at least an int and a shape
+  std::map<cell::type, xt::xtensor<double, 3>> entity_transformations;
+  const std::size_t num_transformations
+      = reader.read_count(sizeof(int) + 3 * sizeof(std::uint64_t));
+  for (std::size_t i = 0; i < num_transformations; ++i)
+  {
+    const int entity_index = reader.read_value<int>();
+    if (entity_index != static_cast<int>(cell::type::interval)
+        and entity_index != static_cast<int>(cell::type::triangle)
+        and entity_index != static_cast<int>(cell::type::quadrilateral))
+    {
+      throw std::runtime_error("Serialized element data is inconsistent.");
+    }
+    const auto entity_type = static_cast<cell::type>(entity_index);
+    xt::xtensor<double, 3> T = reader.read_tensor<double, 3>();
+    if (T.shape(0) != (entity_type == cell::type::interval ? 1 : 2)
+        or T.shape(1) != T.shape(2)
+        or entity_transformations.count(entity_type) != 0)
+    {
+      throw std::runtime_error("Serialized element data is inconsistent.");
+    }
+    entity_transformations[entity_type] = std::move(T);
+  }
+
+  std::array<std::vector<xt::xtensor<double, 2>>, 4> x;
+  for (std::vector<xt::xtensor<double, 2>>& x_d : x)
+  {
+    x_d.resize(reader.read_count(2 * sizeof(std::uint64_t)));
+    for (xt::xtensor<double, 2>& x_e : x_d)
+      x_e = reader.read_tensor<double, 2>();
+  }
+
+  std::array<std::vector<xt::xtensor<double, 3>>, 4> M;
+  for (std::vector<xt::xtensor<double, 3>>& M_d : M)
+  {
+    M_d.resize(reader.read_count(3 * sizeof(std::uint64_t)));
+    for (xt::xtensor<double, 3>& M_e : M_d)
+      M_e = reader.read_tensor<double, 3>();
+  }
+
+  if (!reader.finished())
+    throw std::runtime_error("Serialized element data is too long.");
+
+  // Check that the points and interpolation matrices fit the cell, the
+  // value size and the expansion coefficients
+  std::size_t num_dofs = 0;
+  std::array<std::vector<std::size_t>, 4> num_entity_dofs;
+  for (std::size_t d = 0; d < 4; ++d)
+  {
+    const std::size_t num_entities
+        = d <= tdim ? cell::num_sub_entities(cell_type, d) : 0;
+    if (x[d].size() != M[d].size() or M[d].size() > num_entities)
+      throw std::runtime_error("Serialized element data is inconsistent.");
+    num_entity_dofs[d].resize(num_entities, 0);
+    for (std::size_t e = 0; e < M[d].size(); ++e)
+    {
+      if (x[d][e].shape(1) != tdim or M[d][e].shape(1) != value_size
+          or M[d][e].shape(2) != x[d][e].shape(0))
+      {
+        throw std::runtime_error("Serialized element data is inconsistent.");
+      }
+      num_entity_dofs[d][e] = M[d][e].shape(0);
+      num_dofs += M[d][e].shape(0);
+    }
+  }
+  if (num_dofs != coeffs.shape(0))
+    throw std::runtime_error("Serialized element data is inconsistent.");
+
+  // Check that every edge and face with dofs has an entity
+  // transformation of the right size
+  for (std::size_t d = 1; d < tdim; ++d)
+  {
+    for (std::size_t e = 0; e < num_entity_dofs[d].size(); ++e)
+    {
+      auto it = entity_transformations.find(
+          cell::sub_entity_type(cell_type, d, e));
+      const std::size_t size
+          = it == entity_transformations.end() ? 0 : it->second.shape(1);
+      if (size != num_entity_dofs[d][e])
+        throw std::runtime_error("Serialized element data is inconsistent.");
+    }
+  }
+
+  xt::xtensor<double, 3> coeffs3 = xt::reshape_view(
+      coeffs,
+      {coeffs.shape(0), value_size, coeffs.shape(1) / value_size});
+  return FiniteElement(family, cell_type, degree, value_shape, coeffs3,
+                       entity_transformations, x, M, map_type);
+}
+//-----------------------------------------------------------------------------
 xt::xtensor<double, 3> basix::compute_expansion_coefficients(
     cell::type celltype, const xt::xtensor<double, 2>& B,
     const std::vector<std::vector<xt::xtensor<double, 3>>>& M,
@@ -168,85 +908,103 @@ xt::xtensor<double, 3> basix::compute_expansion_coefficients(
     }
   }
 
-  std::size_t pdim = polyset::dim(celltype, degree);
-  xt::xtensor<double, 3> D = xt::zeros<double>({num_dofs, vs, pdim});
+  const std::size_t pdim = polyset::dim(celltype, degree);
+  if (B.shape(0) != num_dofs or B.shape(1) != vs * pdim)
+    throw std::runtime_error("B has the wrong shape");
 
-  // Loop over different dimensions
+  // Compute the dual matrix D, with shape (num_dofs * vs, pdim). The
+  // rows for the dofs of an entity are the product of Me, with shape
+  // (num_dofs_e * vs, num_points_e), and the polynomial basis at the
+  // points of the entity.
+  xt::xtensor<double, 2> D = xt::zeros<double>({num_dofs * vs, pdim});
+  polyset::workspace<double> w;
+  std::vector<double> P;
   std::size_t dof_index = 0;
   for (std::size_t d = 0; d < M.size(); ++d)
   {
     // Loop over entities of dimension d
     for (std::size_t e = 0; e < x[d].size(); ++e)
     {
-      // Evaluate polynomial basis at x[d]
-      const xt::xtensor<double, 2>& x_e = x[d][e];
-      xt::xtensor<double, 2> P;
-      if (x_e.shape(1) == 1 and x_e.size() != 0)
-      {
-        auto pts = xt::view(x_e, xt::all(), 0);
-        P = xt::view(polyset::tabulate(celltype, degree, 0, pts), 0, xt::all(),
-                     xt::all());
-      }
-      else if (x_e.size() != 0)
-      {
-        P = xt::view(polyset::tabulate(celltype, degree, 0, x_e), 0, xt::all(),
-                     xt::all());
-      }
-
       // Me: [dof, vs, point]
       const xt::xtensor<double, 3>& Me = M[d][e];
+      const xt::xtensor<double, 2>& x_e = x[d][e];
+      if (x_e.size() != 0 and Me.size() != 0)
+      {
+        // Evaluate polynomial basis at x[d][e]
+        P.resize(x_e.shape(0) * pdim);
+        polyset::tabulate(xtl::span<double>(P.data(), P.size()), celltype,
+                          degree, 0,
+                          xtl::span<const double>(x_e.data(), x_e.size()), w);
 
-      // Compute dual matrix contribution
-      for (std::size_t i = 0; i < Me.shape(0); ++i)      // Dof index
-        for (std::size_t j = 0; j < Me.shape(1); ++j)    // Value index
-          for (std::size_t k = 0; k < Me.shape(2); ++k)  // Point
-            for (std::size_t l = 0; l < P.shape(1); ++l) // Polynomial term
-              D(dof_index + i, j, l) += Me(i, j, k) * P(k, l);
-
-      // Dtmp += xt::linalg::dot(Me, P);
+        // Compute dual matrix contribution
+        dot_ab(Me.shape(0) * vs, pdim, Me.shape(2), Me.data(), P.data(),
+               D.data() + dof_index * vs * pdim);
+      }
 
-      dof_index += M[d][e].shape(0);
+      dof_index += Me.shape(0);
     }
   }
 
-  // Compute B D^{T}
-  // xt::xtensor<double, 2> A = xt::zeros<double>({num_dofs, num_dofs});
-  // for (std::size_t i = 0; i < A.shape(0); ++i)
-  //   for (std::size_t j = 0; j < A.shape(1); ++j)
-  //     for (std::size_t k = 0; k < vs; ++k)
-  //       for (std::size_t l = 0; l < B[k].shape(1); ++l)
-  //         A(i, j) += B[k](i, l) * D(j, k, l);
+  // Compute A = B D^{T}, stored column-major for LAPACK, i.e. compute
+  // the row-major matrix D B^{T}
+  const int n = num_dofs;
+  const int ld = std::max(n, 1);
+  std::vector<double> A(num_dofs * num_dofs);
+  dot_abt(num_dofs, num_dofs, vs * pdim, D.data(), B.data(), A.data());
 
-  /// Flatten D and take transpose
-  auto Dt_flat = xt::transpose(
-      xt::reshape_view(D, {D.shape(0), D.shape(1) * D.shape(2)}));
+  // 1-norm of A, for the condition number estimate
+  double anorm = 0.0;
+  for (std::size_t j = 0; j < num_dofs; ++j)
+  {
+    double col_sum = 0.0;
+    for (std::size_t i = 0; i < num_dofs; ++i)
+      col_sum += std::abs(A[j * num_dofs + i]);
+    anorm = std::max(anorm, col_sum);
+  }
 
-  xt::xtensor<double, 2, xt::layout_type::column_major> BDt
-      = xt::linalg::dot(B, Dt_flat);
+  // LU factorisation of A
+  std::vector<int> ipiv(num_dofs);
+  int info = 0;
+  dgetrf_(&n, &n, A.data(), &ld, ipiv.data(), &info);
+  if (info != 0)
+  {
+    throw std::runtime_error("B.D^T is singular when computing expansion "
+                             "coefficients.");
+  }
 
   if (kappa_tol >= 1.0)
   {
-    if (xt::linalg::cond(BDt, 2) > kappa_tol)
+    // Estimate the reciprocal of the condition number in the 1-norm
+    const char norm = '1';
+    double rcond = 0.0;
+    std::vector<double> work(4 * num_dofs);
+    std::vector<int> iwork(num_dofs);
+    dgecon_(&norm, &n, A.data(), &ld, &anorm, &rcond, work.data(),
+            iwork.data(), &info, 1);
+    if (rcond * kappa_tol < 1.0)
     {
       throw std::runtime_error("Condition number of B.D^T when computing "
                                "expansion coefficients exceeds tolerance.");
     }
   }
 
-  // Note: forcing the layout type to get around an xtensor bug with Intel
-  // Compilers
-  // https://github.com/xtensor-stack/xtensor/issues/2351
-  xt::xtensor<double, 2, xt::layout_type::column_major> B_cmajor(
-      {B.shape(0), B.shape(1)});
-  B_cmajor.assign(B);
+  // Compute C = (BD^T)^{-1} B, with B copied to column-major for LAPACK
+  const int nrhs = B.shape(1);
+  std::vector<double> X(B.size());
+  for (std::size_t i = 0; i < B.shape(0); ++i)
+    for (std::size_t j = 0; j < B.shape(1); ++j)
+      X[j * num_dofs + i] = B(i, j);
+  const char trans = 'N';
+  dgetrs_(&trans, &n, &nrhs, A.data(), &ld, ipiv.data(), X.data(), &ld,
+          &info, 1);
 
-  // Compute C = (BD^T)^{-1} B
-  auto result = xt::linalg::solve(BDt, B_cmajor);
+  xt::xtensor<double, 3> C({num_dofs, vs, pdim});
+  auto C2 = xt::reshape_view(C, {num_dofs, vs * pdim});
+  for (std::size_t i = 0; i < B.shape(0); ++i)
+    for (std::size_t j = 0; j < B.shape(1); ++j)
+      C2(i, j) = X[j * num_dofs + i];
 
-  xt::xtensor<double, 2> C({result.shape(0), result.shape(1)});
-  C.assign(result);
-
-  return xt::reshape_view(C, {num_dofs, vs, pdim});
+  return C;
 }
 //-----------------------------------------------------------------------------
 FiniteElement::FiniteElement(
@@ -320,6 +1078,19 @@ FiniteElement::FiniteElement(
     }
   }
 
+  // Factorise the basis into products of 1D functions for
+  // tensor-product cells
+  if (_cell_type == cell::type::quadrilateral
+      or _cell_type == cell::type::hexahedron)
+  {
+    std::tie(_tensor_factor_coeffs, _tensor_factors)
+        = factorise_tensor_coefficients(_coeffs, value_size, _cell_tdim,
+                                        _degree);
+  }
+
+  // Single precision copy of the coefficients
+  _coeffs_float = xt::cast<float>(_coeffs);
+
   // Compute number of dofs for each cell entity (computed from
   // interpolation data)
   const std::vector<std::vector<std::vector<int>>> topology
@@ -395,87 +1166,102 @@ FiniteElement::FiniteElement(
     if (!_dof_transformations_are_permutations)
       break;
   }
+  _etrans_size.fill(0);
+  _etrans_perm_offsets.fill(0);
+  _etrans_data_offsets.fill(0);
+  _etrans_nnz.fill(0);
+  _cell_info_mask = 0;
   if (!_dof_transformations_are_identity)
   {
-    // If transformations are permutations, then create the permutations
-    if (_dof_transformations_are_permutations)
+    // Compute the first DOF of each edge and face whose DOFs are
+    // transformed
+    if (_cell_tdim >= 2)
     {
-      for (const auto& et : _entity_transformations)
+      int dofstart
+          = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
+      for (int ndofs : _num_edofs[1])
       {
-        _eperm[et.first]
-            = std::vector<std::vector<std::size_t>>(et.second.shape(0));
-        _eperm_rev[et.first]
-            = std::vector<std::vector<std::size_t>>(et.second.shape(0));
-        for (std::size_t i = 0; i < et.second.shape(0); ++i)
-        {
-          std::vector<std::size_t> perm(et.second.shape(1));
-          std::vector<std::size_t> rev_perm(et.second.shape(1));
-          for (std::size_t row = 0; row < et.second.shape(1); ++row)
-          {
-            for (std::size_t col = 0; col < et.second.shape(1); ++col)
-            {
-              if (et.second(i, row, col) > 0.5)
-              {
-                perm[row] = col;
-                rev_perm[col] = row;
-                break;
-              }
-            }
-          }
-          // Factorise the permutations
-          _eperm[et.first][i] = precompute::prepare_permutation(perm);
-          _eperm_rev[et.first][i] = precompute::prepare_permutation(rev_perm);
-        }
+        _edge_dofstart.push_back(dofstart);
+        dofstart += ndofs;
       }
-    }
 
-    // Precompute the DOF transformations
-    for (const auto& et : _entity_transformations)
-    {
-      _etrans[et.first] = std::vector<
-          std::tuple<std::vector<std::size_t>, std::vector<double>,
-                     xt::xtensor<double, 2>>>(et.second.shape(0));
-      _etransT[et.first] = std::vector<
-          std::tuple<std::vector<std::size_t>, std::vector<double>,
-                     xt::xtensor<double, 2>>>(et.second.shape(0));
-      _etrans_invT[et.first] = std::vector<
-          std::tuple<std::vector<std::size_t>, std::vector<double>,
-                     xt::xtensor<double, 2>>>(et.second.shape(0));
-      _etrans_inv[et.first] = std::vector<
-          std::tuple<std::vector<std::size_t>, std::vector<double>,
-                     xt::xtensor<double, 2>>>(et.second.shape(0));
-      for (std::size_t i = 0; i < et.second.shape(0); ++i)
+      if (_cell_tdim == 3)
       {
-        if (et.second.shape(1) > 0)
+        for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
         {
-          const xt::xtensor<double, 2>& M
-              = xt::view(et.second, i, xt::all(), xt::all());
-          _etrans[et.first][i] = precompute::prepare_matrix(M);
-          auto M_t = xt::transpose(M);
-          _etransT[et.first][i] = precompute::prepare_matrix(M_t);
-
-          xt::xtensor<double, 2> Minv;
-          // Rotation of a face: this is in the only base transformation such
-          // that M^{-1} != M.
-          // For a quadrilateral face, M^4 = Id, so M^{-1} = M^3.
-          // For a triangular face, M^3 = Id, so M^{-1} = M^2.
-          // This assumes that all faces of the cell are the same shape. For
-          // prisms and pyramids, this will need updating to look at the face
-          // type
-          if (et.first == cell::type::quadrilateral and i == 0)
-            Minv = xt::linalg::dot(xt::linalg::dot(M, M), M);
-          else if (et.first == cell::type::triangle and i == 0)
-            Minv = xt::linalg::dot(M, M);
-          else
-            Minv = M;
-
-          _etrans_inv[et.first][i] = precompute::prepare_matrix(Minv);
-          auto MinvT = xt::transpose(Minv);
-          _etrans_invT[et.first][i] = precompute::prepare_matrix(MinvT);
+          _face_dofstart.push_back(dofstart);
+          _face_type.push_back(etrans_type_index(_cell_subentity_types[2][f]));
+          dofstart += _num_edofs[2][f];
         }
       }
+
+      // The faces use 3 bits each, followed by one bit for each edge
+      const std::size_t face_start = 3 * _face_dofstart.size();
+      for (std::size_t e = 0; e < _edge_dofstart.size(); ++e)
+      {
+        if (_num_edofs[1][e] > 0)
+          _cell_info_mask |= std::uint32_t(1) << (face_start + e);
+      }
+      for (std::size_t f = 0; f < _face_dofstart.size(); ++f)
+      {
+        if (_num_edofs[2][f] > 0)
+          _cell_info_mask |= std::uint32_t(7) << (3 * f);
+      }
     }
-  }
+
+    // Precompute each variant of the combined transformation for each
+    // orientation of each entity type, as permutations if the
+    // transformations are permutations and as matrices otherwise, and
+    // pack them into contiguous buffers
+    for (const auto& [entity_type, T] : _entity_transformations)
+    {
+      const std::size_t t = etrans_type_index(entity_type);
+      _etrans_size[t] = T.shape(1);
+      const auto [M, Minv] = combine_entity_transformations(entity_type, T);
+      for (std::size_t code = 0; code < M.size(); ++code)
+      {
+        const std::array<xt::xtensor<double, 2>, 4> variants
+            = {M[code], xt::transpose(M[code]), Minv[code],
+               xt::transpose(Minv[code])};
+        for (std::size_t v = 0; v < variants.size(); ++v)
+        {
+          const std::size_t i = (4 * t + v) * 8 + code;
+          _etrans_perm_offsets[i] = _etrans_perm.size();
+          _etrans_nnz[i] = std::count_if(
+              variants[v].begin(), variants[v].end(),
+              [](double a) { return std::abs(a) > 1e-12; });
+          if (_dof_transformations_are_permutations)
+          {
+            std::vector<std::size_t> perm(_etrans_size[t]);
+            for (std::size_t row = 0; row < perm.size(); ++row)
+            {
+              for (std::size_t col = 0; col < perm.size(); ++col)
+              {
+                if (variants[v](row, col) > 0.5)
+                {
+                  perm[row] = col;
+                  break;
+                }
+              }
+            }
+
+            // Factorise the permutation
+            perm = precompute::prepare_permutation(perm);
+            _etrans_perm.insert(_etrans_perm.end(), perm.begin(), perm.end());
+          }
+          else
+          {
+            const auto [perm, diag, mat]
+                = precompute::prepare_matrix(variants[v]);
+            _etrans_perm.insert(_etrans_perm.end(), perm.begin(), perm.end());
+            _etrans_data_offsets[i] = _etrans_data.size();
+            _etrans_data.insert(_etrans_data.end(), diag.begin(), diag.end());
+            _etrans_data.insert(_etrans_data.end(), mat.begin(), mat.end());
+          }
+        }
+      }
+    }
+  }
 }
 //-----------------------------------------------------------------------------
 cell::type FiniteElement::cell_type() const { return _cell_type; }
@@ -514,6 +1300,99 @@ const xt::xtensor<double, 2>& FiniteElement::interpolation_matrix() const
   return _matM;
 }
 //-----------------------------------------------------------------------------
+void FiniteElement::interpolate_batch(
+    const xtl::span<const double>& values, const xtl::span<const double>& J,
+    const xtl::span<const double>& detJ, const xtl::span<const double>& K,
+    const xtl::span<const std::uint32_t>& cell_info,
+    const xtl::span<double>& dofs) const
+{
+  const std::size_t ndofs = _matM.shape(0);
+  if (ndofs == 0)
+    return;
+  const std::size_t num_cells = dofs.size() / ndofs;
+  if (dofs.size() != num_cells * ndofs)
+    throw std::runtime_error("DOF array has the wrong size.");
+  if (!cell_info.empty() and cell_info.size() != num_cells)
+    throw std::runtime_error("Cell info array has the wrong size.");
+  if (num_cells == 0)
+    return;
+
+  const std::size_t npts = _points.shape(0);
+  const std::size_t vs = value_size();
+  const std::size_t tdim = _cell_tdim;
+  const bool identity = _map_type == maps::type::identity;
+
+  // The Jacobians have shape (cell, point, gdim, tdim)
+  std::size_t gdim = tdim;
+  if (!identity or !J.empty())
+  {
+    gdim = J.size() / (num_cells * npts * tdim);
+    if (J.size() != num_cells * npts * gdim * tdim or K.size() != J.size()
+        or detJ.size() != num_cells * npts)
+    {
+      throw std::runtime_error("Jacobian arrays have the wrong shape.");
+    }
+  }
+  const std::size_t pvs = identity ? vs : compute_value_size(_map_type, gdim);
+  if (values.size() != num_cells * npts * pvs)
+    throw std::runtime_error("Value array has the wrong shape.");
+
+  // The interpolation matrix has shape (dof, value * point), so the
+  // DOFs of a block of cells are F M^T, where the row of F for a cell
+  // holds its reference values ordered by (value, point)
+  const std::size_t fsize = vs * npts;
+  if (identity and vs == 1)
+  {
+    // The values are already in the required order
+    dot_abt(num_cells, ndofs, fsize, values.data(), _matM.data(),
+            dofs.data());
+  }
+  else
+  {
+    maps::kernel_type kernel = nullptr;
+    if (!identity)
+      kernel = maps::get_kernel(_map_type, tdim, gdim);
+
+    const std::size_t jsize = gdim * tdim;
+    const std::size_t num_blocks
+        = (num_cells + interpolate_block_size - 1) / interpolate_block_size;
+    std::vector<double> F(std::min(num_cells, interpolate_block_size) * fsize);
+    std::vector<double> U(vs);
+    for (std::size_t b = 0; b < num_blocks; ++b)
+    {
+      const std::size_t c0 = b * interpolate_block_size;
+      const std::size_t nc = std::min(interpolate_block_size, num_cells - c0);
+
+      // Pull back the values at each point of each cell in the block
+      for (std::size_t c = 0; c < nc; ++c)
+      {
+        for (std::size_t p = 0; p < npts; ++p)
+        {
+          const std::size_t q = (c0 + c) * npts + p;
+          const double* u = values.data() + q * pvs;
+          if (kernel)
+          {
+            kernel(1, u, K.data() + q * jsize, 1.0 / detJ[q],
+                   J.data() + q * jsize, U.data());
+            u = U.data();
+          }
+          for (std::size_t v = 0; v < vs; ++v)
+            F[c * fsize + v * npts + p] = u[v];
+        }
+      }
+
+      dot_abt(nc, ndofs, fsize, F.data(), fsize, _matM.data(), fsize,
+              dofs.data() + c0 * ndofs, ndofs);
+    }
+  }
+
+  if (!cell_info.empty())
+  {
+    apply_inverse_transpose_dof_transformation_batch(dofs, num_cells, ndofs,
+                                                     1, cell_info);
+  }
+}
+//-----------------------------------------------------------------------------
 const std::vector<std::vector<int>>& FiniteElement::num_entity_dofs() const
 {
   return _num_edofs;
@@ -540,20 +1419,15 @@ FiniteElement::entity_closure_dofs() const
 xt::xtensor<double, 4>
 FiniteElement::tabulate(int nd, const xt::xarray<double>& x) const
 {
-  std::size_t ndsize = 1;
-  for (int i = 1; i <= nd; ++i)
-    ndsize *= (_cell_tdim + i);
-  for (int i = 1; i <= nd; ++i)
-    ndsize /= i;
+  const std::size_t ndsize = polyset::nderivs(_cell_type, nd);
   const std::size_t vs = value_size();
   const std::size_t ndofs = _coeffs.shape(0);
-
-  xt::xarray<double> _x = x;
-  if (_x.dimension() == 1)
-    _x.reshape({_x.shape(0), 1});
+  const std::array<std::size_t, 2> xshape
+      = {x.shape(0), x.dimension() == 1 ? 1 : x.shape(1)};
 
   xt::xtensor<double, 4> data({ndsize, x.shape(0), ndofs, vs});
-  tabulate(nd, _x, data);
+  tabulate(nd, xtl::span<const double>(x.data(), x.size()), xshape,
+           xtl::span<double>(data.data(), data.size()));
 
   return data;
 }
@@ -561,30 +1435,690 @@ FiniteElement::tabulate(int nd, const xt::xarray<double>& x) const
 void FiniteElement::tabulate(int nd, const xt::xarray<double>& x,
                              xt::xtensor<double, 4>& basis_data) const
 {
-  xt::xarray<double> _x = x;
-  if (_x.dimension() == 2 and x.shape(1) == 1)
-    _x.reshape({x.shape(0)});
+  const std::array<std::size_t, 2> xshape
+      = {x.shape(0), x.dimension() == 1 ? 1 : x.shape(1)};
+  if (basis_data.shape(0) != (std::size_t)polyset::nderivs(_cell_type, nd)
+      or basis_data.shape(1) != xshape[0]
+      or basis_data.shape(2) != _coeffs.shape(0)
+      or basis_data.shape(3) != (std::size_t)value_size())
+  {
+    throw std::runtime_error("Basis data array has the wrong shape.");
+  }
+
+  tabulate(nd, xtl::span<const double>(x.data(), x.size()), xshape,
+           xtl::span<double>(basis_data.data(), basis_data.size()));
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::tabulate(int nd, const xtl::span<const T>& x,
+                             std::array<std::size_t, 2> xshape,
+                             const xtl::span<T>& basis_data,
+                             layout::type layout) const
+{
+  TabulateWorkspace<T> w;
+  tabulate(nd, x, xshape, basis_data, w, layout);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::tabulate(int nd, const xtl::span<const T>& x,
+                             std::array<std::size_t, 2> xshape,
+                             const xtl::span<T>& basis_data,
+                             TabulateWorkspace<T>& w,
+                             layout::type layout) const
+{
+  check_tabulate_shape(polyset::nderivs(_cell_type, nd), _coeffs.shape(0),
+                       x.size(), xshape, basis_data.size(), layout);
+  const std::size_t num_points = xshape[0];
+  const std::size_t num_tiles
+      = (num_points + tabulate_tile_size - 1) / tabulate_tile_size;
+  tabulate_tiles(nd, {}, {}, coefficients<T>(), x, num_points, basis_data, 0,
+                 num_tiles, w, layout);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::tabulate(int nd, const xtl::span<const T>& x,
+                             std::array<std::size_t, 2> xshape,
+                             const xtl::span<T>& basis_data, int num_threads,
+                             layout::type layout) const
+{
+  check_tabulate_shape(polyset::nderivs(_cell_type, nd), _coeffs.shape(0),
+                       x.size(), xshape, basis_data.size(), layout);
+  const std::size_t num_points = xshape[0];
+  const std::size_t num_tiles
+      = (num_points + tabulate_tile_size - 1) / tabulate_tile_size;
+  const std::size_t nt
+      = std::min(num_tiles, (std::size_t)std::max(num_threads, 1));
+  if (nt <= 1)
+  {
+    TabulateWorkspace<T> w;
+    tabulate_tiles(nd, {}, {}, coefficients<T>(), x, num_points, basis_data,
+                   0, num_tiles, w, layout);
+    return;
+  }
+
+  // Give each thread a contiguous range of tiles. Each tile writes to
+  // a distinct part of basis_data. An exception thrown by a thread is
+  // stored in its future and rethrown here by get(). If this function
+  // exits early, because starting a thread or get() throws, the
+  // destructors of the remaining futures wait for their threads to
+  // finish, so no thread outlives the data it uses.
+  std::vector<std::future<void>> futures;
+  futures.reserve(nt);
+  for (std::size_t i = 0; i < nt; ++i)
+  {
+    const std::size_t tile0 = i * num_tiles / nt;
+    const std::size_t tile1 = (i + 1) * num_tiles / nt;
+    futures.push_back(std::async(
+        std::launch::async,
+        [&, tile0, tile1]()
+        {
+          TabulateWorkspace<T> w;
+          tabulate_tiles(nd, {}, {}, coefficients<T>(), x, num_points,
+                         basis_data, tile0, tile1, w, layout);
+        }));
+  }
+  for (std::future<void>& f : futures)
+    f.get();
+}
+//-----------------------------------------------------------------------------
+xt::xtensor<double, 4>
+FiniteElement::tabulate(const std::vector<std::array<int, 3>>& derivs,
+                        const xt::xarray<double>& x) const
+{
+  const std::array<std::size_t, 2> xshape
+      = {x.shape(0), x.dimension() == 1 ? 1 : x.shape(1)};
+  xt::xtensor<double, 4> data(
+      {derivs.size(), x.shape(0), _coeffs.shape(0), (std::size_t)value_size()});
+  TabulateWorkspace<double> w;
+  tabulate(derivs, xtl::span<const double>(x.data(), x.size()), xshape,
+           xtl::span<double>(data.data(), data.size()), w);
+  return data;
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::tabulate(const std::vector<std::array<int, 3>>& derivs,
+                             const xtl::span<const T>& x,
+                             std::array<std::size_t, 2> xshape,
+                             const xtl::span<T>& basis_data,
+                             TabulateWorkspace<T>& w,
+                             layout::type layout) const
+{
+  check_tabulate_shape(derivs.size(), _coeffs.shape(0), x.size(), xshape,
+                       basis_data.size(), layout);
+  if (derivs.empty())
+    return;
+
+  // Index of derivative (p, q, r) in the polyset table
+  auto index = [tdim = _cell_tdim](int p, int q, int r)
+  {
+    if (tdim == 1)
+      return idx(p);
+    else if (tdim == 2)
+      return idx(p, q);
+    else
+      return idx(p, q, r);
+  };
+
+  // Find the highest derivative order
+  int nd = 0;
+  for (const std::array<int, 3>& d : derivs)
+  {
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+      if (d[i] < 0 or (i >= _cell_tdim and d[i] != 0))
+        throw std::runtime_error("Invalid derivative.");
+    }
+    nd = std::max(nd, d[0] + d[1] + d[2]);
+  }
+
+  // Flag the requested derivatives and all lower derivatives in each
+  // direction, which are used by the polyset recurrences
+  w.mask.assign(polyset::nderivs(_cell_type, nd), 0);
+  w.derivs.resize(derivs.size());
+  for (std::size_t i = 0; i < derivs.size(); ++i)
+  {
+    const auto [p, q, r] = derivs[i];
+    w.derivs[i] = index(p, q, r);
+    for (int a = 0; a <= p; ++a)
+      for (int b = 0; b <= q; ++b)
+        for (int c = 0; c <= r; ++c)
+          w.mask[index(a, b, c)] = 1;
+  }
+
+  const std::size_t num_points = xshape[0];
+  const std::size_t num_tiles
+      = (num_points + tabulate_tile_size - 1) / tabulate_tile_size;
+  tabulate_tiles(nd, xtl::span<const int>(w.derivs.data(), w.derivs.size()),
+                 xtl::span<const int>(w.mask.data(), w.mask.size()),
+                 coefficients<T>(), x, num_points, basis_data, 0, num_tiles, w,
+                 layout);
+}
+//-----------------------------------------------------------------------------
+xt::xtensor<double, 4>
+FiniteElement::tabulate(int nd, const std::vector<int>& dofs,
+                        const xt::xarray<double>& x) const
+{
+  const std::array<std::size_t, 2> xshape
+      = {x.shape(0), x.dimension() == 1 ? 1 : x.shape(1)};
+  xt::xtensor<double, 4> data(
+      {(std::size_t)polyset::nderivs(_cell_type, nd), x.shape(0), dofs.size(),
+       (std::size_t)value_size()});
+  TabulateWorkspace<double> w;
+  tabulate(nd, dofs, xtl::span<const double>(x.data(), x.size()), xshape,
+           xtl::span<double>(data.data(), data.size()), w);
+  return data;
+}
+//-----------------------------------------------------------------------------
+xt::xtensor<double, 4>
+FiniteElement::tabulate_entity_closure(int nd, int entity_dim,
+                                       int entity_index,
+                                       const xt::xarray<double>& x) const
+{
+  const std::set<int>& dofs = _e_closure_dofs.at(entity_dim).at(entity_index);
+  return tabulate(nd, std::vector<int>(dofs.begin(), dofs.end()), x);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::tabulate(int nd, const std::vector<int>& dofs,
+                             const xtl::span<const T>& x,
+                             std::array<std::size_t, 2> xshape,
+                             const xtl::span<T>& basis_data,
+                             TabulateWorkspace<T>& w,
+                             layout::type layout) const
+{
+  check_tabulate_shape(polyset::nderivs(_cell_type, nd), dofs.size(),
+                       x.size(), xshape, basis_data.size(), layout);
 
-  if (_x.shape(1) != _cell_tdim)
+  // Copy the expansion coefficients of the requested dofs, so that the
+  // contraction only involves these rows
+  const xtl::span<const T> coeffs = coefficients<T>();
+  const std::size_t row_size = _coeffs.shape(1);
+  w.coeffs.resize(dofs.size() * row_size);
+  for (std::size_t i = 0; i < dofs.size(); ++i)
+  {
+    if (dofs[i] < 0 or dofs[i] >= (int)_coeffs.shape(0))
+      throw std::runtime_error("Invalid dof index.");
+    std::copy_n(coeffs.begin() + dofs[i] * row_size, row_size,
+                w.coeffs.begin() + i * row_size);
+  }
+
+  const std::size_t num_points = xshape[0];
+  const std::size_t num_tiles
+      = (num_points + tabulate_tile_size - 1) / tabulate_tile_size;
+  tabulate_tiles(nd, {}, {},
+                 xtl::span<const T>(w.coeffs.data(), w.coeffs.size()), x,
+                 num_points, basis_data, 0, num_tiles, w, layout);
+}
+//-----------------------------------------------------------------------------
+xt::xtensor<double, 5>
+FiniteElement::tabulate_sub_entities(int nd, int dim,
+                                     const xt::xtensor<double, 2>& x) const
+{
+  if (dim < 0 or dim > (int)_cell_tdim)
+    throw std::runtime_error("Invalid dimension for sub-entity");
+  const std::size_t num_entities = cell::num_sub_entities(_cell_type, dim);
+  xt::xtensor<double, 5> data(
+      {num_entities, (std::size_t)polyset::nderivs(_cell_type, nd),
+       x.shape(0), _coeffs.shape(0), (std::size_t)value_size()});
+  TabulateWorkspace<double> w;
+  tabulate_sub_entities(nd, dim, xtl::span<const double>(x.data(), x.size()),
+                        {x.shape(0), x.shape(1)},
+                        xtl::span<double>(data.data(), data.size()), w);
+  return data;
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::tabulate_sub_entities(int nd, int dim,
+                                          const xtl::span<const T>& x,
+                                          std::array<std::size_t, 2> xshape,
+                                          const xtl::span<T>& basis_data,
+                                          TabulateWorkspace<T>& w,
+                                          layout::type layout) const
+{
+  const std::vector<std::vector<std::vector<int>>> topology
+      = cell::topology(_cell_type);
+  if (dim < 0 or dim >= (int)topology.size())
+    throw std::runtime_error("Invalid dimension for sub-entity");
+  if (xshape[1] != (std::size_t)dim)
+    throw std::runtime_error("Point dim does not match sub-entity dim.");
+  if (x.size() != xshape[0] * xshape[1])
+    throw std::runtime_error("Points array has the wrong size.");
+
+  const std::vector<std::vector<int>>& entities = topology[dim];
+  const std::vector<cell::type>& entity_types = _cell_subentity_types[dim];
+  for (cell::type t : entity_types)
+  {
+    if (t != entity_types[0])
+      throw std::runtime_error("Sub-entities have different cell types.");
+  }
+
+  const std::vector<std::size_t> shape
+      = tabulate_shape(nd, xshape[0], layout);
+  std::size_t size = 1;
+  for (std::size_t s : shape)
+    size *= s;
+  if (basis_data.size() != entities.size() * size)
+    throw std::runtime_error("Basis data array has the wrong shape.");
+
+  // Find the vertices of the reference sub-entity at the end of each
+  // axis, e.g. vertices 1, 2 and 4 of a hexahedron
+  const xt::xtensor<double, 2> entity_geometry
+      = cell::geometry(entity_types[0]);
+  std::vector<std::size_t> axes(dim);
+  for (int i = 0; i < dim; ++i)
+  {
+    for (std::size_t k = 1; k < entity_geometry.shape(0); ++k)
+    {
+      bool is_axis = true;
+      for (int j = 0; j < dim; ++j)
+        is_axis = is_axis and entity_geometry(k, j) == (i == j ? 1.0 : 0.0);
+      if (is_axis)
+      {
+        axes[i] = k;
+        break;
+      }
+    }
+  }
+
+  // Map the points onto each sub-entity, x = v0 + sum_i x_i (v_{a_i} -
+  // v0), where a_i are the axis vertices, and tabulate. The workspace
+  // is reused for every sub-entity.
+  const xt::xtensor<double, 2> geometry = cell::geometry(_cell_type);
+  const std::size_t num_points = xshape[0];
+  w.points.resize(num_points * _cell_tdim);
+  for (std::size_t e = 0; e < entities.size(); ++e)
+  {
+    const std::vector<int>& v = entities[e];
+    for (std::size_t p = 0; p < num_points; ++p)
+    {
+      for (std::size_t j = 0; j < _cell_tdim; ++j)
+      {
+        const double v0 = geometry(v[0], j);
+        double y = v0;
+        for (std::size_t i = 0; i < xshape[1]; ++i)
+          y += x[p * xshape[1] + i] * (geometry(v[axes[i]], j) - v0);
+        w.points[p * _cell_tdim + j] = y;
+      }
+    }
+
+    tabulate(nd, xtl::span<const T>(w.points.data(), w.points.size()),
+             {num_points, _cell_tdim}, basis_data.subspan(e * size, size), w,
+             layout);
+  }
+}
+//-----------------------------------------------------------------------------
+xt::xtensor<double, 5>
+FiniteElement::tabulate_facets(int nd, const xt::xtensor<double, 2>& x) const
+{
+  return tabulate_sub_entities(nd, _cell_tdim - 1, x);
+}
+//-----------------------------------------------------------------------------
+void FiniteElement::tabulate_physical(
+    int nd, const xtl::span<const double>& x,
+    std::array<std::size_t, 2> xshape, const xtl::span<const double>& J,
+    const xtl::span<const double>& detJ, const xtl::span<const double>& K,
+    const xtl::span<const std::uint32_t>& cell_info,
+    const xtl::span<double>& basis_data, TabulateWorkspace<double>& w) const
+{
+  const std::size_t num_cells = cell_info.size();
+  const std::size_t num_points = xshape[0];
+  const std::size_t tdim = xshape[1];
+  if (tdim != (std::size_t)_cell_tdim or x.size() != num_points * tdim)
+    throw std::runtime_error("Point array has the wrong shape.");
+  if (detJ.size() != num_cells * num_points)
+    throw std::runtime_error("Jacobian determinant array has the wrong size.");
+  if (num_cells == 0 or num_points == 0)
+    return;
+
+  // The Jacobians have shape (cell, point, gdim, tdim)
+  const std::size_t jsize = J.size() / (num_cells * num_points);
+  const std::size_t gdim = jsize / tdim;
+  if (J.size() != num_cells * num_points * gdim * tdim or K.size() != J.size())
+    throw std::runtime_error("Jacobian array has the wrong shape.");
+
+  const std::size_t nderivs = polyset::nderivs(_cell_type, nd);
+  const std::size_t ndofs = _coeffs.shape(0);
+  const std::size_t vs = value_size();
+  const std::size_t pvs = _map_type == maps::type::identity
+                              ? vs
+                              : compute_value_size(_map_type, gdim);
+  if (basis_data.size() != num_cells * nderivs * num_points * ndofs * pvs)
+    throw std::runtime_error("Basis data array has the wrong shape.");
+
+  // Select the map kernel once for all the cells
+  maps::kernel_type kernel = nullptr;
+  if (_map_type != maps::type::identity)
+    kernel = maps::get_kernel(_map_type, gdim, tdim);
+
+  // Size of the table at one point, with shape (dof, value)
+  const std::size_t rsize = ndofs * vs;
+  w.transformed.resize(rsize);
+
+  const std::size_t num_tiles
+      = (num_points + tabulate_tile_size - 1) / tabulate_tile_size;
+  for (std::size_t tile = 0; tile < num_tiles; ++tile)
+  {
+    const std::size_t p0 = tile * tabulate_tile_size;
+    const std::size_t np = std::min(tabulate_tile_size, num_points - p0);
+
+    // Tabulate on the reference at the points in this tile, with
+    // shape (derivative, point, dof, value)
+    w.reference.resize(nderivs * np * rsize);
+    tabulate_tiles(nd, {}, {}, coefficients<double>(),
+                   x.subspan(p0 * tdim, np * tdim), np,
+                   xtl::span<double>(w.reference.data(), w.reference.size()),
+                   0, 1, w, layout::type::pointDofValue);
+
+    for (std::size_t c = 0; c < num_cells; ++c)
+    {
+      for (std::size_t d = 0; d < nderivs; ++d)
+      {
+        for (std::size_t p = 0; p < np; ++p)
+        {
+          // Apply the DOF transformation to the table at this point
+          const double* phi = w.reference.data() + (d * np + p) * rsize;
+          if (!_dof_transformations_are_identity)
+          {
+            std::copy_n(phi, rsize, w.transformed.begin());
+            apply_dof_transformation(
+                xtl::span<double>(w.transformed.data(), rsize), vs,
+                cell_info[c]);
+            phi = w.transformed.data();
+          }
+
+          // Map the value of each DOF to the physical cell
+          const std::size_t q = c * num_points + p0 + p;
+          double* out = basis_data.data()
+                        + ((c * nderivs + d) * num_points + p0 + p) * ndofs
+                              * pvs;
+          if (kernel)
+          {
+            kernel(ndofs, phi, J.data() + q * jsize, detJ[q],
+                   K.data() + q * jsize, out);
+          }
+          else
+            std::copy_n(phi, rsize, out);
+        }
+      }
+    }
+  }
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+xtl::span<const T> FiniteElement::coefficients() const
+{
+  if constexpr (std::is_same<T, float>::value)
+    return xtl::span<const T>(_coeffs_float.data(), _coeffs_float.size());
+  else
+    return xtl::span<const T>(_coeffs.data(), _coeffs.size());
+}
+//-----------------------------------------------------------------------------
+std::vector<std::size_t>
+FiniteElement::tabulate_shape(int nd, std::size_t num_points,
+                              layout::type layout) const
+{
+  const std::size_t ndsize = polyset::nderivs(_cell_type, nd);
+  const std::size_t ndofs = _coeffs.shape(0);
+  const std::size_t vs = value_size();
+  switch (layout)
+  {
+  case layout::type::pointDofValue:
+    return {ndsize, num_points, ndofs, vs};
+  case layout::type::pointValueDof:
+    return {ndsize, num_points, vs, ndofs};
+  case layout::type::valuePointDof:
+    return {ndsize, vs, num_points, ndofs};
+  case layout::type::valueDofPoint:
+    return {ndsize, vs, ndofs, num_points};
+  case layout::type::interleaved:
+    return {ndsize,
+            (num_points + layout::block_size - 1) / layout::block_size, vs,
+            ndofs, layout::block_size};
+  default:
+    throw std::runtime_error("Unknown layout");
+  }
+}
+//-----------------------------------------------------------------------------
+void FiniteElement::check_tabulate_shape(std::size_t num_derivs,
+                                         std::size_t ndofs, std::size_t xsize,
+                                         std::array<std::size_t, 2> xshape,
+                                         std::size_t basis_data_size,
+                                         layout::type layout) const
+{
+  if (xshape[1] != _cell_tdim)
     throw std::runtime_error("Point dim does not match element dim.");
+  if (xsize != xshape[0] * xshape[1])
+    throw std::runtime_error("Points array has the wrong size.");
 
-  xt::xtensor<double, 3> basis = polyset::tabulate(_cell_type, _degree, nd, _x);
-  const int psize = polyset::dim(_cell_type, _degree);
-  const int vs = value_size();
-  xt::xtensor<double, 2> B, C;
-  for (std::size_t p = 0; p < basis.shape(0); ++p)
+  // The interleaved layout pads the points to a whole number of blocks
+  std::size_t num_points = xshape[0];
+  if (layout == layout::type::interleaved)
   {
-    for (int j = 0; j < vs; ++j)
+    num_points = layout::block_size
+                 * ((num_points + layout::block_size - 1) / layout::block_size);
+  }
+
+  const std::size_t vs = value_size();
+  if (basis_data_size != num_derivs * num_points * ndofs * vs)
+    throw std::runtime_error("Basis data array has the wrong shape.");
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::tabulate_tiles(int nd, const xtl::span<const int>& derivs,
+                                   const xtl::span<const int>& mask,
+                                   const xtl::span<const T>& coeffs,
+                                   const xtl::span<const T>& x,
+                                   std::size_t num_points,
+                                   const xtl::span<T>& basis_data,
+                                   std::size_t tile0, std::size_t tile1,
+                                   TabulateWorkspace<T>& w,
+                                   layout::type layout) const
+{
+  // Number of derivatives in the polyset table and in the output
+  const std::size_t ndsize = polyset::nderivs(_cell_type, nd);
+  const std::size_t nout = derivs.empty() ? ndsize : derivs.size();
+
+  const std::size_t psize = polyset::dim(_cell_type, _degree);
+  const std::size_t vs = value_size();
+  const std::size_t ndofs = coeffs.size() / (vs * psize);
+  const std::size_t ncols = ndofs * vs;
+  if (ncols == 0)
+    return;
+
+  const std::size_t bs = layout::block_size;
+  const std::size_t num_blocks = (num_points + bs - 1) / bs;
+  T* out = basis_data.data();
+  for (std::size_t tile = tile0; tile < tile1; ++tile)
+  {
+    const std::size_t p0 = tile * tabulate_tile_size;
+    const std::size_t np = std::min(tabulate_tile_size, num_points - p0);
+
+    // Tabulate the polyset at the points in this tile into the
+    // workspace. Resizing does not reallocate once the buffer has
+    // reached the required capacity.
+    w.P.resize(ndsize * np * psize);
+    polyset::tabulate(xtl::span<T>(w.P.data(), w.P.size()), _cell_type,
+                      _degree, nd, x.subspan(p0 * _cell_tdim, np * _cell_tdim),
+                      w.polyset, mask);
+
+    // Polyset table for output derivative d
+    auto Pd = [&](std::size_t d) -> const T*
+    { return w.P.data() + (derivs.empty() ? d : derivs[d]) * np * psize; };
+
+    // The polyset table has shape (derivative, point, poly index) and
+    // the coefficients have shape (dof, value, poly index), both
+    // row-major. The table for derivative d and value component v is
+    // the matrix product P_d C_v^T, where the rows of C_v are vs *
+    // psize apart. Each layout writes these products (or their
+    // transposes) directly to their place in the output.
+    switch (layout)
     {
-      auto basis_view = xt::view(basis_data, p, xt::all(), xt::all(), j);
-      B = xt::view(basis, p, xt::all(), xt::all());
-      C = xt::view(_coeffs, xt::all(), xt::range(psize * j, psize * j + psize));
-      auto result = xt::linalg::dot(B, xt::transpose(C));
-      basis_view.assign(result);
+    case layout::type::pointDofValue:
+      if (np == num_points and derivs.empty())
+      {
+        // Flattening the leading two indices of P and C, the whole
+        // table is a single matrix product
+        dot_abt(ndsize * np, ncols, psize, w.P.data(), coeffs.data(),
+                out);
+      }
+      else
+      {
+        for (std::size_t d = 0; d < nout; ++d)
+        {
+          dot_abt(np, ncols, psize, Pd(d), psize, coeffs.data(), psize,
+                  out + (d * num_points + p0) * ncols, ncols);
+        }
+      }
+      break;
+    case layout::type::pointValueDof:
+      for (std::size_t d = 0; d < nout; ++d)
+      {
+        for (std::size_t v = 0; v < vs; ++v)
+        {
+          dot_abt(np, ndofs, psize, Pd(d), psize,
+                  coeffs.data() + v * psize, vs * psize,
+                  out + (d * num_points + p0) * ncols + v * ndofs, ncols);
+        }
+      }
+      break;
+    case layout::type::valuePointDof:
+      for (std::size_t d = 0; d < nout; ++d)
+      {
+        for (std::size_t v = 0; v < vs; ++v)
+        {
+          dot_abt(np, ndofs, psize, Pd(d), psize,
+                  coeffs.data() + v * psize, vs * psize,
+                  out + ((d * vs + v) * num_points + p0) * ndofs, ndofs);
+        }
+      }
+      break;
+    case layout::type::valueDofPoint:
+      for (std::size_t d = 0; d < nout; ++d)
+      {
+        for (std::size_t v = 0; v < vs; ++v)
+        {
+          dot_abt(ndofs, np, psize, coeffs.data() + v * psize, vs * psize,
+                  Pd(d), psize,
+                  out + (d * vs + v) * ndofs * num_points + p0, num_points);
+        }
+      }
+      break;
+    case layout::type::interleaved:
+      for (std::size_t d = 0; d < nout; ++d)
+      {
+        for (std::size_t b = 0; b < (np + bs - 1) / bs; ++b)
+        {
+          // Number of points in this block, and the block index in the
+          // full table
+          const std::size_t nb = std::min(bs, np - b * bs);
+          const std::size_t block = p0 / bs + b;
+          for (std::size_t v = 0; v < vs; ++v)
+          {
+            T* out_b = out + ((d * num_blocks + block) * vs + v) * ndofs * bs;
+            dot_abt(ndofs, nb, psize, coeffs.data() + v * psize, vs * psize,
+                    Pd(d) + b * bs * psize, psize, out_b, bs);
+
+            // Zero the padding in the last block
+            for (std::size_t i = 0; i < ndofs; ++i)
+              std::fill(out_b + i * bs + nb, out_b + (i + 1) * bs, T(0));
+          }
+        }
+      }
+      break;
+    default:
+      throw std::runtime_error("Unknown layout");
     }
   }
 }
 //-----------------------------------------------------------------------------
+// Explicit instantiation for double and float
+template void FiniteElement::tabulate(int, const xtl::span<const double>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<double>&,
+                                      layout::type) const;
+template void FiniteElement::tabulate(int, const xtl::span<const float>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<float>&,
+                                      layout::type) const;
+template void FiniteElement::tabulate(int, const xtl::span<const double>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<double>&,
+                                      TabulateWorkspace<double>&,
+                                      layout::type) const;
+template void FiniteElement::tabulate(int, const xtl::span<const float>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<float>&,
+                                      TabulateWorkspace<float>&,
+                                      layout::type) const;
+template void FiniteElement::tabulate(int, const xtl::span<const double>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<double>&, int,
+                                      layout::type) const;
+template void FiniteElement::tabulate(int, const xtl::span<const float>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<float>&, int,
+                                      layout::type) const;
+template void FiniteElement::tabulate(const std::vector<std::array<int, 3>>&,
+                                      const xtl::span<const double>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<double>&,
+                                      TabulateWorkspace<double>&,
+                                      layout::type) const;
+template void FiniteElement::tabulate(const std::vector<std::array<int, 3>>&,
+                                      const xtl::span<const float>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<float>&,
+                                      TabulateWorkspace<float>&,
+                                      layout::type) const;
+template void FiniteElement::tabulate(int, const std::vector<int>&,
+                                      const xtl::span<const double>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<double>&,
+                                      TabulateWorkspace<double>&,
+                                      layout::type) const;
+template void FiniteElement::tabulate(int, const std::vector<int>&,
+                                      const xtl::span<const float>&,
+                                      std::array<std::size_t, 2>,
+                                      const xtl::span<float>&,
+                                      TabulateWorkspace<float>&,
+                                      layout::type) const;
+template void FiniteElement::tabulate_sub_entities(
+    int, int, const xtl::span<const double>&, std::array<std::size_t, 2>,
+    const xtl::span<double>&, TabulateWorkspace<double>&, layout::type) const;
+template void FiniteElement::tabulate_sub_entities(
+    int, int, const xtl::span<const float>&, std::array<std::size_t, 2>,
+    const xtl::span<float>&, TabulateWorkspace<float>&, layout::type) const;
+//-----------------------------------------------------------------------------
+std::pair<std::vector<xt::xtensor<double, 3>>, xt::xtensor<int, 3>>
+FiniteElement::tabulate_tensor_factors(
+    int nd, const std::vector<xt::xtensor<double, 1>>& x) const
+{
+  if (_tensor_factor_coeffs.empty())
+  {
+    throw std::runtime_error("The basis of this element does not factorise "
+                             "into one-dimensional functions.");
+  }
+
+  if (x.size() != _cell_tdim)
+    throw std::runtime_error("One set of points is needed for each direction.");
+
+  std::vector<xt::xtensor<double, 3>> tables;
+  for (std::size_t d = 0; d < _cell_tdim; ++d)
+  {
+    // 1D orthonormal polynomials and their derivatives, with shape
+    // (derivative, point, poly index)
+    xt::xtensor<double, 3> P
+        = polyset::tabulate(cell::type::interval, _degree, nd, x[d]);
+    const xt::xtensor<double, 2>& F = _tensor_factor_coeffs[d];
+    xt::xtensor<double, 3> t({P.shape(0), P.shape(1), F.shape(0)});
+    dot_abt(P.shape(0) * P.shape(1), F.shape(0), F.shape(1), P.data(),
+            F.data(), t.data());
+    tables.push_back(std::move(t));
+  }
+
+  return {std::move(tables), _tensor_factors};
+}
+//-----------------------------------------------------------------------------
 xt::xtensor<double, 3> FiniteElement::base_transformations() const
 {
   const std::size_t nt = num_transformations(cell_type());
@@ -654,7 +2188,21 @@ xt::xtensor<double, 3> FiniteElement::map_push_forward(
   const std::size_t physical_value_size
       = compute_value_size(_map_type, J.shape(1));
   xt::xtensor<double, 3> u({U.shape(0), U.shape(1), physical_value_size});
-  map_push_forward_m(U, J, detJ, K, u);
+  if (_map_type == maps::type::identity)
+    map_push_forward_m(U, J, detJ, K, u);
+  else
+  {
+    // Select the kernel once, and then apply it for each Jacobian
+    const maps::kernel_type kernel
+        = maps::get_kernel(_map_type, J.shape(1), J.shape(2));
+    const std::size_t jsize = J.shape(1) * J.shape(2);
+    for (std::size_t i = 0; i < U.shape(0); ++i)
+    {
+      kernel(U.shape(1), U.data() + i * U.shape(1) * U.shape(2),
+             J.data() + i * jsize, detJ[i], K.data() + i * jsize,
+             u.data() + i * u.shape(1) * u.shape(2));
+    }
+  }
   return u;
 }
 //-----------------------------------------------------------------------------
@@ -664,10 +2212,67 @@ xt::xtensor<double, 3> FiniteElement::map_pull_back(
 {
   const std::size_t reference_value_size = value_size();
   xt::xtensor<double, 3> U({u.shape(0), u.shape(1), reference_value_size});
-  map_pull_back_m(u, J, detJ, K, U);
+  if (_map_type == maps::type::identity)
+    map_pull_back_m(u, J, detJ, K, U);
+  else
+  {
+    // The inverse map is the map with J and K swapped and 1 / detJ
+    const maps::kernel_type kernel
+        = maps::get_kernel(_map_type, K.shape(1), K.shape(2));
+    const std::size_t jsize = J.shape(1) * J.shape(2);
+    for (std::size_t i = 0; i < u.shape(0); ++i)
+    {
+      kernel(u.shape(1), u.data() + i * u.shape(1) * u.shape(2),
+             K.data() + i * jsize, 1.0 / detJ[i], J.data() + i * jsize,
+             U.data() + i * U.shape(1) * U.shape(2));
+    }
+  }
   return U;
 }
 //-----------------------------------------------------------------------------
+void FiniteElement::map_push_forward_affine(const xtl::span<const double>& U,
+                                            const xt::xtensor<double, 2>& J,
+                                            double detJ,
+                                            const xt::xtensor<double, 2>& K,
+                                            const xtl::span<double>& u) const
+{
+  // Dispatch on the map type once, when computing the matrix
+  xt::xtensor<double, 2> A;
+  if (map_type != maps::type::identity)
+    A = maps::affine_map_matrix(J, detJ, K, map_type);
+  apply_affine_map(map_type, A, U, u);
+}
+//-----------------------------------------------------------------------------
+void FiniteElement::map_pull_back_affine(const xtl::span<const double>& u,
+                                         const xt::xtensor<double, 2>& J,
+                                         double detJ,
+                                         const xt::xtensor<double, 2>& K,
+                                         const xtl::span<double>& U) const
+{
+  xt::xtensor<double, 2> A;
+  if (map_type != maps::type::identity)
+    A = maps::affine_map_matrix(K, 1.0 / detJ, J, map_type);
+  apply_affine_map(map_type, A, u, U);
+}
+//-----------------------------------------------------------------------------
+void FiniteElement::map_push_forward_derivatives(
+    int nd, const xtl::span<const double>& U, std::size_t num_points,
+    const xtl::span<const double>& J, const xtl::span<const double>& detJ,
+    const xtl::span<const double>& K, const xtl::span<const double>& dJ,
+    const xtl::span<double>& u) const
+{
+  if (num_points == 0)
+    return;
+
+  const std::size_t tdim = _cell_tdim;
+  const std::size_t gdim = J.size() / (num_points * tdim);
+  maps::push_forward_derivatives(
+      _map_type, nd, U,
+      {(std::size_t)polyset::nderivs(_cell_type, nd), num_points,
+       (std::size_t)dim(), (std::size_t)value_size()},
+      J, {gdim, tdim}, detJ, K, dJ, u);
+}
+//-----------------------------------------------------------------------------
 void FiniteElement::permute_dofs(const xtl::span<std::int32_t>& dofs,
                                  std::uint32_t cell_info) const
 {
@@ -677,96 +2282,187 @@ void FiniteElement::permute_dofs(const xtl::span<std::int32_t>& dofs,
         "The DOF transformations for this element are not permutations");
   }
 
-  if (_dof_transformations_are_identity)
-    return;
+  apply_entity_transformations<false>(dofs, 1, cell_info,
+                                      doftransform::type::standard);
+}
+//-----------------------------------------------------------------------------
+void FiniteElement::unpermute_dofs(const xtl::span<std::int32_t>& dofs,
+                                   std::uint32_t cell_info) const
+{
+  if (!_dof_transformations_are_permutations)
+  {
+    throw std::runtime_error(
+        "The DOF transformations for this element are not permutations");
+  }
+  apply_entity_transformations<false>(dofs, 1, cell_info,
+                                      doftransform::type::transpose);
+}
+//-----------------------------------------------------------------------------
+std::vector<std::tuple<std::size_t, std::uint32_t, int>>
+FiniteElement::entity_orientations(std::uint32_t cell_info) const
+{
+  std::vector<std::tuple<std::size_t, std::uint32_t, int>> orientations;
 
-  if (_cell_tdim >= 2)
+  // This assumes 3 bits are used per face. This will need updating if 3D
+  // cells with faces with more than 4 sides are implemented
+  const std::size_t face_start = 3 * _face_dofstart.size();
+  for (std::size_t e = 0; e < _edge_dofstart.size(); ++e)
   {
-    // This assumes 3 bits are used per face. This will need updating if 3D
-    // cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
+    if (cell_info >> (face_start + e) & 1)
+      orientations.emplace_back(0, 1, _edge_dofstart[e]);
+  }
 
-    // Permute DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
-    {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_permutation(_eperm.at(cell::type::interval)[0], dofs,
-                                      dofstart);
-      dofstart += _num_edofs[1][e];
-    }
+  for (std::size_t f = 0; f < _face_dofstart.size(); ++f)
+  {
+    if (std::uint32_t code = cell_info >> (3 * f) & 7; code != 0)
+      orientations.emplace_back(_face_type[f], code, _face_dofstart[f]);
+  }
+
+  return orientations;
+}
+//-----------------------------------------------------------------------------
+std::size_t
+FiniteElement::entity_transformation_cost(std::uint32_t cell_info) const
+{
+  std::size_t cost = 0;
+  for (auto [t, code, dofstart] : entity_orientations(cell_info))
+  {
+    const std::size_t n = _etrans_size[t];
+    cost += _dof_transformations_are_permutations ? n : n * n;
+  }
+  return cost;
+}
+//-----------------------------------------------------------------------------
+std::size_t
+FiniteElement::dof_transformation_matrix_nnz(std::uint32_t cell_info,
+                                             doftransform::type type) const
+{
+  // The matrix is the identity apart from a block for each transformed
+  // entity
+  const std::size_t v = static_cast<std::size_t>(type);
+  std::size_t nnz = dim();
+  for (auto [t, code, dofstart] : entity_orientations(cell_info))
+    nnz = nnz - _etrans_size[t] + _etrans_nnz[(4 * t + v) * 8 + code];
+  return nnz;
+}
+//-----------------------------------------------------------------------------
+std::shared_ptr<const DofTransformationMatrix>
+FiniteElement::dof_transformation_matrix(std::uint32_t cell_info,
+                                         doftransform::type type) const
+{
+  // Ignore the bits of cell_info that do not change the matrix, so
+  // that orientations that only differ in these bits share a matrix
+  cell_info &= _cell_info_mask;
 
-    if (_cell_tdim == 3)
+  DofTransformationCache& cache = _dof_transformation_cache;
+  const std::uint64_t key
+      = static_cast<std::uint64_t>(type) << 32 | std::uint64_t(cell_info);
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (auto it = cache.matrices.find(key); it != cache.matrices.end())
+      return it->second;
+  }
+
+  // Compute the matrix by transforming the identity, and drop the
+  // entries that are zero up to rounding
+  const std::size_t ndofs = dim();
+  std::vector<double> T(ndofs * ndofs, 0);
+  for (std::size_t i = 0; i < ndofs; ++i)
+    T[i * ndofs + i] = 1;
+  apply_entity_transformations<false>(xtl::span<double>(T), ndofs, cell_info,
+                                      type);
+
+  auto matrix = std::make_shared<DofTransformationMatrix>();
+  matrix->offsets.push_back(0);
+  for (std::size_t i = 0; i < ndofs; ++i)
+  {
+    for (std::size_t j = 0; j < ndofs; ++j)
     {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
+      if (std::abs(T[i * ndofs + j]) > 1e-12)
       {
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_permutation(
-              _eperm.at(_cell_subentity_types[2][f])[1], dofs, dofstart);
+        matrix->columns.push_back(j);
+        matrix->values.push_back(T[i * ndofs + j]);
+      }
+    }
+    matrix->offsets.push_back(matrix->columns.size());
+  }
 
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_permutation(
-              _eperm.at(_cell_subentity_types[2][f])[0], dofs, dofstart);
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  if (cache.size == 0)
+    return matrix;
 
-        dofstart += _num_edofs[2][f];
-      }
+  // Another thread may have added the matrix while it was computed
+  auto [it, inserted] = cache.matrices.emplace(key, matrix);
+  if (inserted)
+  {
+    cache.order.push_back(key);
+    if (cache.order.size() > cache.size)
+    {
+      cache.matrices.erase(cache.order.front());
+      cache.order.pop_front();
     }
   }
+
+  return it->second;
 }
 //-----------------------------------------------------------------------------
-void FiniteElement::unpermute_dofs(const xtl::span<std::int32_t>& dofs,
-                                   std::uint32_t cell_info) const
+void FiniteElement::set_dof_transformation_cache_size(std::size_t size)
 {
-  if (!_dof_transformations_are_permutations)
+  DofTransformationCache& cache = _dof_transformation_cache;
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.size = size;
+  while (cache.order.size() > size)
   {
-    throw std::runtime_error(
-        "The DOF transformations for this element are not permutations");
+    cache.matrices.erase(cache.order.front());
+    cache.order.pop_front();
   }
-  if (_dof_transformations_are_identity)
-    return;
+}
+//-----------------------------------------------------------------------------
+std::size_t FiniteElement::dof_transformation_cache_size() const
+{
+  std::lock_guard<std::mutex> lock(_dof_transformation_cache.mutex);
+  return _dof_transformation_cache.size;
+}
+//-----------------------------------------------------------------------------
+std::vector<char> FiniteElement::serialize() const
+{
+  std::vector<char> buffer;
+  write_array(buffer, serialize_magic.data(), serialize_magic.size());
+  write_value<std::uint32_t>(buffer, serialize_version);
 
-  if (_cell_tdim >= 2)
-  {
-    // This assumes 3 bits are used per face. This will need updating if 3D
-    // cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
+  write_value<int>(buffer, static_cast<int>(_family));
+  write_value<int>(buffer, static_cast<int>(_cell_type));
+  write_value<int>(buffer, _degree);
+  write_value<int>(buffer, static_cast<int>(_map_type));
 
-    // Permute DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
-    {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_permutation(_eperm_rev.at(cell::type::interval)[0],
-                                      dofs, dofstart);
-      dofstart += _num_edofs[1][e];
-    }
+  write_value<std::uint64_t>(buffer, _value_shape.size());
+  for (int v : _value_shape)
+    write_value<std::uint64_t>(buffer, v);
 
-    if (_cell_tdim == 3)
-    {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
-      {
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_permutation(
-              _eperm_rev.at(_cell_subentity_types[2][f])[0], dofs, dofstart);
+  write_tensor(buffer, _coeffs);
 
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_permutation(
-              _eperm_rev.at(_cell_subentity_types[2][f])[1], dofs, dofstart);
+  write_value<std::uint64_t>(buffer, _entity_transformations.size());
+  for (const auto& [entity_type, et] : _entity_transformations)
+  {
+    write_value<int>(buffer, static_cast<int>(entity_type));
+    write_tensor(buffer, et);
+  }
 
-        dofstart += _num_edofs[2][f];
-      }
-    }
+  for (const std::vector<xt::xtensor<double, 2>>& x_d : _x)
+  {
+    write_value<std::uint64_t>(buffer, x_d.size());
+    for (const xt::xtensor<double, 2>& x_e : x_d)
+      write_tensor(buffer, x_e);
   }
+
+  for (const std::vector<xt::xtensor<double, 3>>& M_d : _matM_new)
+  {
+    write_value<std::uint64_t>(buffer, M_d.size());
+    for (const xt::xtensor<double, 3>& M_e : M_d)
+      write_tensor(buffer, M_e);
+  }
+
+  return buffer;
 }
 //-----------------------------------------------------------------------------
 std::map<cell::type, xt::xtensor<double, 3>>
@@ -10,10 +10,17 @@
 #include "cell.h"
 #include "element-families.h"
 #include "maps.h"
+#include "polyset.h"
 #include "precompute.h"
+#include <algorithm>
 #include <array>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <xtensor/xadapt.hpp>
@@ -174,10 +181,10 @@ namespace basix
 /// (num_entities, num_points_per_entity, tdim).
 /// @param[in] degree The degree of the polynomial basis P used to
 /// create the element (before applying B)
-/// @param[in] kappa_tol If positive, the condition number is computed
-/// and an error thrown if the condition number of \f$B D^{T}\f$ is
-/// greater than @p kappa_tol. If @p kappa_tol is less than 1 the
-/// condition number is not checked.
+/// @param[in] kappa_tol If positive, the condition number of \f$B
+/// D^{T}\f$ in the 1-norm is estimated from its LU factorisation and
+/// an error thrown if it is greater than @p kappa_tol. If @p kappa_tol
+/// is less than 1 the condition number is not checked.
 /// @return The matrix C of expansion coefficients that define the basis
 /// functions of the finite element space. The shape is (num_dofs,
 /// value_size, basis_dim)
@@ -187,6 +194,94 @@ xt::xtensor<double, 3> compute_expansion_coefficients(
     const std::vector<std::vector<xt::xtensor<double, 2>>>& x, int degree,
     double kappa_tol = 0.0);
 
+/// Memory layouts for tables of basis functions
+namespace layout
+{
+/// Index ordering of the tables written by FiniteElement::tabulate.
+/// The derivative is always the slowest index.
+enum class type
+{
+  pointDofValue = 0,
+  pointValueDof = 1,
+  valuePointDof = 2,
+  valueDofPoint = 3,
+  interleaved = 4,
+};
+
+/// Number of points in each block of the layout::type::interleaved
+/// (array of structures of arrays) layout. The table has shape
+/// (derivative, point block, value, dof, point in block), with the
+/// points padded with zero values to a multiple of the block size.
+constexpr std::size_t block_size = 8;
+} // namespace layout
+
+namespace doftransform
+{
+/// The variants of the DOF transformation of a cell. If the DOF
+/// transformation matrix of the cell is T, these are T, T^T, T^{-1}
+/// and T^{-T}.
+enum class type
+{
+  standard = 0,
+  transpose = 1,
+  inverse = 2,
+  inverse_transpose = 3,
+};
+} // namespace doftransform
+
+/// Scratch memory for FiniteElement::tabulate. The buffers grow as
+/// required, so passing the same workspace to repeated calls avoids
+/// memory allocation once they have reached the size needed for the
+/// largest set of points.
+template <typename T>
+struct TabulateWorkspace
+{
+  /// The orthonormal polynomial set tabulated at the points
+  std::vector<T> P;
+
+  /// Scratch memory for polyset::tabulate
+  polyset::workspace<T> polyset;
+
+  /// Polyset derivative index of each requested derivative, when
+  /// tabulating a subset of the derivatives
+  std::vector<int> derivs;
+
+  /// Polyset derivatives that are needed to compute the requested
+  /// derivatives, when tabulating a subset of the derivatives
+  std::vector<int> mask;
+
+  /// Expansion coefficients of the requested basis functions, when
+  /// tabulating a subset of the basis functions
+  std::vector<T> coeffs;
+
+  /// Points mapped onto a sub-entity of the cell, when tabulating on
+  /// sub-entities
+  std::vector<T> points;
+
+  /// Basis functions on the reference at the points in a tile, when
+  /// tabulating on physical cells
+  std::vector<T> reference;
+
+  /// The basis functions at one point after the DOF transformation,
+  /// when tabulating on physical cells
+  std::vector<T> transformed;
+};
+
+/// The DOF transformation matrix of a cell, in compressed sparse row
+/// format
+struct DofTransformationMatrix
+{
+  /// The entries of row i are entries offsets[i] to offsets[i + 1] of
+  /// columns and values
+  std::vector<std::int32_t> offsets;
+
+  /// The column of each entry
+  std::vector<std::int32_t> columns;
+
+  /// The value of each entry
+  std::vector<double> values;
+};
+
 /// Finite Element
 /// The basis is stored as a set of coefficients, which are applied to the
 /// underlying expansion set for that cell type, when tabulating.
@@ -258,6 +353,286 @@ public:
   void tabulate(int nd, const xt::xarray<double>& x,
                 xt::xtensor<double, 4>& basis_data) const;
 
+  /// Compute basis values and derivatives at set of points, writing
+  /// the result into caller-owned memory. The points are not copied,
+  /// and no memory is allocated when @p w has previously been used to
+  /// tabulate at the same number of points or more. The points must be
+  /// stored contiguously; strided input is not supported.
+  ///
+  /// This function is instantiated for `T = double` and `T = float`.
+  /// In single precision, the expansion coefficients that are
+  /// computed in double precision when the element is created are
+  /// used rounded to float.
+  ///
+  /// @param[in] nd The order of derivatives, up to and including, to
+  /// compute. Use 0 for the basis functions only.
+  /// @param[in] x The points at which to compute the basis functions,
+  /// stored row-major
+  /// @param[in] xshape The shape of @p x, i.e. (number of points,
+  /// topological dimension)
+  /// @param[out] basis_data Memory for the basis functions (and
+  /// derivatives), stored row-major with the shape given by
+  /// FiniteElement::tabulate_shape for @p layout. For the default
+  /// layout, this is the shape (derivative, point, basis fn index,
+  /// value index) of the array returned by FiniteElement::tabulate.
+  /// @param[in,out] w Workspace
+  /// @param[in] layout The ordering of the indices of @p basis_data
+  template <typename T>
+  void tabulate(int nd, const xtl::span<const T>& x,
+                std::array<std::size_t, 2> xshape,
+                const xtl::span<T>& basis_data, TabulateWorkspace<T>& w,
+                layout::type layout = layout::type::pointDofValue) const;
+
+  /// Compute basis values and derivatives at set of points, writing
+  /// the result into caller-owned memory. This version uses a
+  /// temporary workspace.
+  /// @param[in] nd The order of derivatives
+  /// @param[in] x The points, stored row-major
+  /// @param[in] xshape The shape of @p x
+  /// @param[out] basis_data Memory for the basis functions (and
+  /// derivatives)
+  /// @param[in] layout The ordering of the indices of @p basis_data
+  template <typename T>
+  void tabulate(int nd, const xtl::span<const T>& x,
+                std::array<std::size_t, 2> xshape,
+                const xtl::span<T>& basis_data,
+                layout::type layout = layout::type::pointDofValue) const;
+
+  /// Compute basis values and derivatives at set of points, writing
+  /// the result into caller-owned memory, using multiple threads. The
+  /// points are split into fixed-size tiles which are distributed
+  /// over the threads, and the result is bitwise identical to the
+  /// serial version. If a thread throws, the exception is rethrown on
+  /// the calling thread once all the threads have finished.
+  /// @param[in] nd The order of derivatives
+  /// @param[in] x The points, stored row-major
+  /// @param[in] xshape The shape of @p x
+  /// @param[out] basis_data Memory for the basis functions (and
+  /// derivatives)
+  /// @param[in] num_threads The number of threads to use
+  /// @param[in] layout The ordering of the indices of @p basis_data
+  template <typename T>
+  void tabulate(int nd, const xtl::span<const T>& x,
+                std::array<std::size_t, 2> xshape,
+                const xtl::span<T>& basis_data, int num_threads,
+                layout::type layout = layout::type::pointDofValue) const;
+
+  /// Compute a selection of derivatives of the basis functions at a
+  /// set of points. Only the derivatives of the orthonormal polynomial
+  /// set that are needed to compute the requested derivatives are
+  /// computed.
+  /// @param[in] derivs The derivatives to compute, given as the number
+  /// of derivatives in the x, y and z directions. Entries for
+  /// directions beyond the topological dimension must be zero, e.g.
+  /// {{1, 0, 0}, {0, 1, 0}} for the gradient on a triangle.
+  /// @param[in] x The points at which to compute the basis functions,
+  /// with shape (number of points, topological dimension)
+  /// @return The derivatives of the basis functions. The shape is
+  /// (derivative, point, basis fn index, value index), with the first
+  /// index following the order of @p derivs.
+  xt::xtensor<double, 4>
+  tabulate(const std::vector<std::array<int, 3>>& derivs,
+           const xt::xarray<double>& x) const;
+
+  /// Compute a selection of derivatives of the basis functions at a
+  /// set of points, writing the result into caller-owned memory
+  /// @param[in] derivs The derivatives to compute, given as the number
+  /// of derivatives in the x, y and z directions
+  /// @param[in] x The points, stored row-major
+  /// @param[in] xshape The shape of @p x
+  /// @param[out] basis_data Memory for the derivatives of the basis
+  /// functions, with the first index of the shape given by
+  /// FiniteElement::tabulate_shape being the size of @p derivs
+  /// @param[in,out] w Workspace
+  /// @param[in] layout The ordering of the indices of @p basis_data
+  template <typename T>
+  void tabulate(const std::vector<std::array<int, 3>>& derivs,
+                const xtl::span<const T>& x,
+                std::array<std::size_t, 2> xshape,
+                const xtl::span<T>& basis_data, TabulateWorkspace<T>& w,
+                layout::type layout = layout::type::pointDofValue) const;
+
+  /// Compute a subset of the basis functions, and their derivatives,
+  /// at a set of points. Only the expansion coefficients of the
+  /// requested basis functions are used.
+  /// @param[in] nd The order of derivatives, up to and including, to
+  /// compute. Use 0 for the basis functions only.
+  /// @param[in] dofs The indices of the basis functions to compute
+  /// @param[in] x The points at which to compute the basis functions,
+  /// with shape (number of points, topological dimension)
+  /// @return The basis functions (and derivatives). The shape is
+  /// (derivative, point, basis fn, value index), where the third index
+  /// is the position in @p dofs.
+  xt::xtensor<double, 4> tabulate(int nd, const std::vector<int>& dofs,
+                                  const xt::xarray<double>& x) const;
+
+  /// Compute the basis functions associated with the closure of a
+  /// sub-entity of the cell, and their derivatives, at a set of
+  /// points. See FiniteElement::entity_closure_dofs.
+  /// @param[in] nd The order of derivatives
+  /// @param[in] entity_dim The dimension of the sub-entity
+  /// @param[in] entity_index The index of the sub-entity
+  /// @param[in] x The points at which to compute the basis functions,
+  /// with shape (number of points, topological dimension)
+  /// @return The basis functions (and derivatives), with shape
+  /// (derivative, point, basis fn, value index). The basis functions
+  /// are ordered as in FiniteElement::entity_closure_dofs.
+  xt::xtensor<double, 4>
+  tabulate_entity_closure(int nd, int entity_dim, int entity_index,
+                          const xt::xarray<double>& x) const;
+
+  /// Compute a subset of the basis functions, and their derivatives,
+  /// at a set of points, writing the result into caller-owned memory
+  /// @param[in] nd The order of derivatives
+  /// @param[in] dofs The indices of the basis functions to compute
+  /// @param[in] x The points, stored row-major
+  /// @param[in] xshape The shape of @p x
+  /// @param[out] basis_data Memory for the basis functions (and
+  /// derivatives), with the number of dofs in the shape given by
+  /// FiniteElement::tabulate_shape being the size of @p dofs
+  /// @param[in,out] w Workspace
+  /// @param[in] layout The ordering of the indices of @p basis_data
+  template <typename T>
+  void tabulate(int nd, const std::vector<int>& dofs,
+                const xtl::span<const T>& x,
+                std::array<std::size_t, 2> xshape,
+                const xtl::span<T>& basis_data, TabulateWorkspace<T>& w,
+                layout::type layout = layout::type::pointDofValue) const;
+
+  /// Compute the basis functions, and their derivatives, at a set of
+  /// points on each sub-entity of a given dimension, e.g. at a facet
+  /// quadrature rule on every facet of the cell. The points are given
+  /// on the reference sub-entity and are mapped onto each sub-entity
+  /// by the affine map that takes the origin and the ends of the axes
+  /// of the reference sub-entity (e.g. vertices 0, 1, 2 and 4 of a
+  /// hexahedron) to the matching vertices of the sub-entity. All the
+  /// sub-entities must have the same cell type.
+  /// @param[in] nd The order of derivatives, up to and including, to
+  /// compute. Use 0 for the basis functions only.
+  /// @param[in] dim The dimension of the sub-entities
+  /// @param[in] x The points on the reference sub-entity, with shape
+  /// (number of points, dim)
+  /// @return The basis functions (and derivatives). The shape is
+  /// (sub-entity, derivative, point, basis fn index, value index).
+  xt::xtensor<double, 5>
+  tabulate_sub_entities(int nd, int dim,
+                        const xt::xtensor<double, 2>& x) const;
+
+  /// Compute the basis functions, and their derivatives, at a set of
+  /// points on each sub-entity of a given dimension, writing the result
+  /// into caller-owned memory. The workspace is shared by all the
+  /// sub-entities.
+  /// @param[in] nd The order of derivatives
+  /// @param[in] dim The dimension of the sub-entities
+  /// @param[in] x The points on the reference sub-entity, stored
+  /// row-major
+  /// @param[in] xshape The shape of @p x, i.e. (number of points, dim)
+  /// @param[out] basis_data Memory for the basis functions (and
+  /// derivatives). The table for each sub-entity has the shape given
+  /// by FiniteElement::tabulate_shape, and the tables are stored one
+  /// after the other.
+  /// @param[in,out] w Workspace
+  /// @param[in] layout The ordering of the indices of the table for
+  /// each sub-entity
+  template <typename T>
+  void tabulate_sub_entities(int nd, int dim, const xtl::span<const T>& x,
+                             std::array<std::size_t, 2> xshape,
+                             const xtl::span<T>& basis_data,
+                             TabulateWorkspace<T>& w,
+                             layout::type layout
+                             = layout::type::pointDofValue) const;
+
+  /// Compute the basis functions, and their derivatives, at a set of
+  /// points on each facet of the cell. See
+  /// FiniteElement::tabulate_sub_entities.
+  /// @param[in] nd The order of derivatives
+  /// @param[in] x The points on the reference facet, with shape
+  /// (number of points, tdim - 1)
+  /// @return The basis functions (and derivatives). The shape is
+  /// (facet, derivative, point, basis fn index, value index).
+  xt::xtensor<double, 5> tabulate_facets(int nd,
+                                         const xt::xtensor<double, 2>& x) const;
+
+  /// Compute the basis functions, and their derivatives, on a batch of
+  /// physical cells. This gives the same result as
+  /// FiniteElement::tabulate, followed by
+  /// FiniteElement::apply_dof_transformation and
+  /// FiniteElement::map_push_forward for each cell, but the points are
+  /// processed in tiles so that each tile passes through all three
+  /// steps while it is in cache. The table on the reference is
+  /// computed once per tile and shared by all the cells.
+  ///
+  /// The derivatives are derivatives with respect to the reference
+  /// coordinates, and the map is applied to each derivative in the
+  /// same way as to the values.
+  ///
+  /// @param[in] nd The order of derivatives
+  /// @param[in] x The points on the reference, stored row-major
+  /// @param[in] xshape The shape of @p x, i.e. (number of points,
+  /// topological dimension)
+  /// @param[in] J The Jacobian at each point of each cell, with shape
+  /// (cell, point, gdim, tdim)
+  /// @param[in] detJ The determinant of the Jacobian, with shape
+  /// (cell, point)
+  /// @param[in] K The inverse of the Jacobian, with shape (cell,
+  /// point, tdim, gdim)
+  /// @param[in] cell_info The permutation info of each cell. Its size
+  /// is the number of cells.
+  /// @param[out] basis_data The basis functions (and derivatives),
+  /// with shape (cell, derivative, point, basis fn index, physical
+  /// value index)
+  /// @param[in,out] w Workspace
+  void tabulate_physical(int nd, const xtl::span<const double>& x,
+                         std::array<std::size_t, 2> xshape,
+                         const xtl::span<const double>& J,
+                         const xtl::span<const double>& detJ,
+                         const xtl::span<const double>& K,
+                         const xtl::span<const std::uint32_t>& cell_info,
+                         const xtl::span<double>& basis_data,
+                         TabulateWorkspace<double>& w) const;
+
+  /// The shape of the table of basis functions written by
+  /// FiniteElement::tabulate
+  /// @param[in] nd The order of derivatives
+  /// @param[in] num_points The number of points
+  /// @param[in] layout The ordering of the indices of the table
+  /// @return The shape of the table
+  std::vector<std::size_t> tabulate_shape(int nd, std::size_t num_points,
+                                          layout::type layout) const;
+
+  /// Tabulate the one-dimensional factors of the basis functions on a
+  /// tensor-product set of points. This is supported on quadrilaterals
+  /// and hexahedra for elements whose basis functions are (component
+  /// by component) products of 1D functions, e.g. Lagrange, RTCF and
+  /// NCE. Using the factors avoids the cost and memory of the full
+  /// table returned by FiniteElement::tabulate, which has size
+  /// @f$O(p^{2d})@f$ for degree @f$p@f$ in @f$d@f$ dimensions.
+  ///
+  /// The tensor-product points are all combinations `(x[0][i],
+  /// x[1][j], x[2][k])`. In the ordering used by
+  /// quadrature::make_quadrature, the index of this point is `i + n0 *
+  /// (j + n1 * k)`, where `n0 = x[0].size()` and `n1 = x[1].size()`.
+  ///
+  /// Component `c` of derivative `(a, b, e)` of basis function `f` at
+  /// point `(i, j, k)` is given by
+  /// @code{.cpp}
+  /// auto [tables, factors] = element.tabulate_tensor_factors(nd, x);
+  /// tables[0](a, i, factors(f, c, 0)) * tables[1](b, j, factors(f, c, 1))
+  ///     * tables[2](e, k, factors(f, c, 2))
+  /// @endcode
+  /// and is zero if any of the factors is -1.
+  ///
+  /// @param[in] nd The order of derivatives, up to and including, to
+  /// compute. Use 0 for the basis functions only.
+  /// @param[in] x The 1D points in each direction
+  /// @return The tabulated 1D functions for each direction, with shape
+  /// (derivative, point, function index), and the index of the 1D
+  /// function in each direction for each basis function and value
+  /// component, with shape (basis fn index, value index, tdim).
+  std::pair<std::vector<xt::xtensor<double, 3>>, xt::xtensor<int, 3>>
+  tabulate_tensor_factors(int nd,
+                          const std::vector<xt::xtensor<double, 1>>& x) const;
+
   /// Get the element cell type
   /// @return The cell type
   cell::type cell_type() const;
@@ -349,6 +724,23 @@ public:
     }
   }
 
+  /// Map function values from the reference to a physical cell with
+  /// an affine geometry, on which J, detJ and K are the same at every
+  /// point. The map is applied to all the values with one
+  /// matrix-matrix product.
+  /// @param[in] U The function values on the reference, with shape (n,
+  /// reference value size), e.g. a table with shape (points, dofs,
+  /// reference value size)
+  /// @param[in] J The Jacobian of the mapping
+  /// @param[in] detJ The determinant of the Jacobian of the mapping
+  /// @param[in] K The inverse of the Jacobian of the mapping
+  /// @param[out] u The function values on the cell, with shape (n,
+  /// physical value size)
+  void map_push_forward_affine(const xtl::span<const double>& U,
+                               const xt::xtensor<double, 2>& J, double detJ,
+                               const xt::xtensor<double, 2>& K,
+                               const xtl::span<double>& u) const;
+
   /// Map function values from a physical cell to the reference
   /// @param[in] u The function values on the cell
   /// @param[in] J The Jacobian of the mapping
@@ -360,6 +752,48 @@ public:
                                        const xtl::span<const double>& detJ,
                                        const xt::xtensor<double, 3>& K) const;
 
+  /// Map function values from a physical cell with an affine geometry
+  /// to the reference. See FiniteElement::map_push_forward_affine.
+  /// @param[in] u The function values on the cell, with shape (n,
+  /// physical value size)
+  /// @param[in] J The Jacobian of the mapping
+  /// @param[in] detJ The determinant of the Jacobian of the mapping
+  /// @param[in] K The inverse of the Jacobian of the mapping
+  /// @param[out] U The function values on the reference, with shape (n,
+  /// reference value size)
+  void map_pull_back_affine(const xtl::span<const double>& u,
+                            const xt::xtensor<double, 2>& J, double detJ,
+                            const xt::xtensor<double, 2>& K,
+                            const xtl::span<double>& U) const;
+
+  /// Map the basis functions, and their first and second derivatives,
+  /// from the reference to a physical cell. The derivatives on the
+  /// physical cell are with respect to the physical coordinates. On a
+  /// cell with a non-affine geometry, they include the terms with the
+  /// derivatives of J. See maps::push_forward_derivatives.
+  /// @param[in] nd The order of derivatives (0, 1 or 2)
+  /// @param[in] U The table computed by FiniteElement::tabulate, with
+  /// shape (derivative, point, basis fn index, value index)
+  /// @param[in] num_points The number of points
+  /// @param[in] J The Jacobian at each point, with shape (point, gdim,
+  /// tdim)
+  /// @param[in] detJ The determinant of J at each point
+  /// @param[in] K The inverse of J at each point, with shape (point,
+  /// tdim, gdim)
+  /// @param[in] dJ The derivatives of J of order 1 to @p nd, with
+  /// shape (derivative, point, gdim, tdim). Pass an empty array for a
+  /// cell with an affine geometry.
+  /// @param[out] u The mapped table, with shape (derivative, point,
+  /// basis fn index, physical value index), where the derivatives are
+  /// ordered as in FiniteElement::tabulate for gdim coordinates
+  void map_push_forward_derivatives(int nd, const xtl::span<const double>& U,
+                                    std::size_t num_points,
+                                    const xtl::span<const double>& J,
+                                    const xtl::span<const double>& detJ,
+                                    const xtl::span<const double>& K,
+                                    const xtl::span<const double>& dJ,
+                                    const xtl::span<double>& u) const;
+
   /// Map function values from a physical cell back to to the reference
   ///
   /// @param[in] u Data defined on the physical element. It must have
@@ -589,6 +1023,166 @@ public:
   void apply_inverse_dof_transformation_to_transpose(
       const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const;
 
+  /// Apply DOF transformations to the data of several cells
+  /// @param[in,out] data The data. The data of cell c starts at
+  /// `c * stride` and has the same layout as the data passed to
+  /// FiniteElement::apply_dof_transformation
+  /// @param ncells The number of cells
+  /// @param stride The distance between the data of consecutive cells
+  /// @param block_size The number of data points per DOF
+  /// @param cell_info The permutation info for each cell
+  template <typename T>
+  void apply_dof_transformation_batch(
+      const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+      int block_size, const xtl::span<const std::uint32_t>& cell_info) const;
+
+  /// Apply transpose DOF transformations to the data of several cells
+  /// @param[in,out] data The data. The data of cell c starts at
+  /// `c * stride` and has the same layout as the data passed to
+  /// FiniteElement::apply_transpose_dof_transformation
+  /// @param ncells The number of cells
+  /// @param stride The distance between the data of consecutive cells
+  /// @param block_size The number of data points per DOF
+  /// @param cell_info The permutation info for each cell
+  template <typename T>
+  void apply_transpose_dof_transformation_batch(
+      const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+      int block_size, const xtl::span<const std::uint32_t>& cell_info) const;
+
+  /// Apply inverse transpose DOF transformations to the data of several cells
+  /// @param[in,out] data The data. The data of cell c starts at
+  /// `c * stride` and has the same layout as the data passed to
+  /// FiniteElement::apply_inverse_transpose_dof_transformation
+  /// @param ncells The number of cells
+  /// @param stride The distance between the data of consecutive cells
+  /// @param block_size The number of data points per DOF
+  /// @param cell_info The permutation info for each cell
+  template <typename T>
+  void apply_inverse_transpose_dof_transformation_batch(
+      const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+      int block_size, const xtl::span<const std::uint32_t>& cell_info) const;
+
+  /// Apply inverse DOF transformations to the data of several cells
+  /// @param[in,out] data The data. The data of cell c starts at
+  /// `c * stride` and has the same layout as the data passed to
+  /// FiniteElement::apply_inverse_dof_transformation
+  /// @param ncells The number of cells
+  /// @param stride The distance between the data of consecutive cells
+  /// @param block_size The number of data points per DOF
+  /// @param cell_info The permutation info for each cell
+  template <typename T>
+  void apply_inverse_dof_transformation_batch(
+      const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+      int block_size, const xtl::span<const std::uint32_t>& cell_info) const;
+
+  /// Apply DOF transformations to the transposed data of several cells
+  /// @param[in,out] data The data. The data of cell c starts at
+  /// `c * stride` and has the same layout as the data passed to
+  /// FiniteElement::apply_dof_transformation_to_transpose
+  /// @param ncells The number of cells
+  /// @param stride The distance between the data of consecutive cells
+  /// @param block_size The number of data points per DOF
+  /// @param cell_info The permutation info for each cell
+  template <typename T>
+  void apply_dof_transformation_to_transpose_batch(
+      const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+      int block_size, const xtl::span<const std::uint32_t>& cell_info) const;
+
+  /// Apply transpose DOF transformations to the transposed data of
+  /// several cells
+  /// @param[in,out] data The data. The data of cell c starts at
+  /// `c * stride` and has the same layout as the data passed to
+  /// FiniteElement::apply_transpose_dof_transformation_to_transpose
+  /// @param ncells The number of cells
+  /// @param stride The distance between the data of consecutive cells
+  /// @param block_size The number of data points per DOF
+  /// @param cell_info The permutation info for each cell
+  template <typename T>
+  void apply_transpose_dof_transformation_to_transpose_batch(
+      const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+      int block_size, const xtl::span<const std::uint32_t>& cell_info) const;
+
+  /// Apply inverse transpose DOF transformations to the transposed data
+  /// of several cells
+  /// @param[in,out] data The data. The data of cell c starts at
+  /// `c * stride` and has the same layout as the data passed to
+  /// FiniteElement::apply_inverse_transpose_dof_transformation_to_transpose
+  /// @param ncells The number of cells
+  /// @param stride The distance between the data of consecutive cells
+  /// @param block_size The number of data points per DOF
+  /// @param cell_info The permutation info for each cell
+  template <typename T>
+  void apply_inverse_transpose_dof_transformation_to_transpose_batch(
+      const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+      int block_size, const xtl::span<const std::uint32_t>& cell_info) const;
+
+  /// Apply inverse DOF transformations to the transposed data of several cells
+  /// @param[in,out] data The data. The data of cell c starts at
+  /// `c * stride` and has the same layout as the data passed to
+  /// FiniteElement::apply_inverse_dof_transformation_to_transpose
+  /// @param ncells The number of cells
+  /// @param stride The distance between the data of consecutive cells
+  /// @param block_size The number of data points per DOF
+  /// @param cell_info The permutation info for each cell
+  template <typename T>
+  void apply_inverse_dof_transformation_to_transpose_batch(
+      const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+      int block_size, const xtl::span<const std::uint32_t>& cell_info) const;
+
+  /// Apply DOF transformations to both sides of an element matrix in
+  /// a single pass. The rows of A are split into one block of
+  /// `dim() * block_size` rows for each entry of cell_info0, and the
+  /// columns into one block for each entry of cell_info1, as for the
+  /// two cells of an interior facet. If M_i and M_j are the
+  /// transformations of the given type for the cells with permutation
+  /// info cell_info0[i] and cell_info1[j], block (i, j) of A is replaced
+  /// by M_i A_ij M_j^T. For example, doftransform::type::transpose
+  /// gives T_i^T A_ij T_j.
+  ///
+  /// This computes the same result as applying the transformation to
+  /// the rows of A and then to its columns, but each row is transformed
+  /// on both sides while it is in cache.
+  /// @param[in,out] A The element matrix, in row-major order
+  /// @param cell_info0 The permutation info of the cells of the rows
+  /// @param cell_info1 The permutation info of the cells of the columns
+  /// @param type The transformation to apply
+  /// @param block_size The number of rows (and columns) per DOF
+  template <typename T>
+  void transform_element_matrix(
+      const xtl::span<T>& A, const xtl::span<const std::uint32_t>& cell_info0,
+      const xtl::span<const std::uint32_t>& cell_info1, doftransform::type type,
+      int block_size = 1) const;
+
+  /// Return the DOF transformation matrix of a cell as a sparse
+  /// matrix. The matrices are created when they are first requested,
+  /// and kept in a cache of the size set by
+  /// FiniteElement::set_dof_transformation_cache_size.
+  /// @param cell_info The permutation info for the cell
+  /// @param type The transformation
+  /// @return The matrix, which has dim() rows and columns
+  std::shared_ptr<const DofTransformationMatrix>
+  dof_transformation_matrix(
+      std::uint32_t cell_info,
+      doftransform::type type = doftransform::type::standard) const;
+
+  /// Set the maximum number of matrices kept by
+  /// FiniteElement::dof_transformation_matrix. When the cache is full,
+  /// the oldest matrix is removed. If the size is not zero, the
+  /// batched functions (FiniteElement::apply_dof_transformation_batch
+  /// etc.) apply the cached matrix of each orientation instead of
+  /// transforming each entity when the matrix has fewer nonzeros than
+  /// the number of operations needed to transform the entities. Each
+  /// element has its own cache: a copy of an element starts with the
+  /// size and the matrices of the original, and changing the size of
+  /// one does not change the other. The default size is 0.
+  /// @param size The number of matrices
+  void set_dof_transformation_cache_size(std::size_t size);
+
+  /// Get the maximum number of matrices kept by
+  /// FiniteElement::dof_transformation_matrix
+  /// @return The number of matrices
+  std::size_t dof_transformation_cache_size() const;
+
   /// Return the interpolation points, i.e. the coordinates on the
   /// reference element where a function need to be evaluated in order
   /// to interpolate it in the finite element space.
@@ -606,10 +1200,139 @@ public:
   /// interpolated function.
   const xt::xtensor<double, 2>& interpolation_matrix() const;
 
+  /// Interpolate a function into the element on a batch of cells. The
+  /// values are pulled back to the reference, and the interpolation
+  /// matrix is applied to the cells in blocks, with one matrix-matrix
+  /// product per block.
+  /// @param[in] values The values of the function at the points
+  /// FiniteElement::points() mapped to each cell, with shape (cell,
+  /// point, physical value index)
+  /// @param[in] J The Jacobian at each point, with shape (cell, point,
+  /// gdim, tdim). This may be empty if the map type is
+  /// maps::type::identity.
+  /// @param[in] detJ The determinant of J at each point, with shape
+  /// (cell, point)
+  /// @param[in] K The inverse of J at each point, with shape (cell,
+  /// point, tdim, gdim)
+  /// @param[in] cell_info The permutation info of each cell. If this
+  /// is not empty, the inverse transpose DOF transformation of each
+  /// cell is applied to its DOFs.
+  /// @param[out] dofs The DOFs of the interpolant, with shape (cell,
+  /// dof). Its size determines the number of cells.
+  void interpolate_batch(const xtl::span<const double>& values,
+                         const xtl::span<const double>& J,
+                         const xtl::span<const double>& detJ,
+                         const xtl::span<const double>& K,
+                         const xtl::span<const std::uint32_t>& cell_info,
+                         const xtl::span<double>& dofs) const;
+
+  /// Write the element to a compact binary representation, which can
+  /// be read by basix::deserialize_element. The data that defines the
+  /// element (the expansion coefficients, interpolation points and
+  /// matrices, and entity transformations) is stored, so reading an
+  /// element does not repeat the computation of the coefficients.
+  /// @return The binary representation of the element
+  std::vector<char> serialize() const;
+
   /// Element map type
   maps::type map_type;
 
 private:
+  // The expansion coefficients in the precision T
+  template <typename T>
+  xtl::span<const T> coefficients() const;
+
+  // Check the sizes of the arrays passed to FiniteElement::tabulate
+  void check_tabulate_shape(std::size_t num_derivs, std::size_t ndofs,
+                            std::size_t xsize,
+                            std::array<std::size_t, 2> xshape,
+                            std::size_t basis_data_size,
+                            layout::type layout) const;
+
+  // Tabulate the basis functions with expansion coefficients coeffs
+  // at the points in tiles [tile0, tile1) of a point set with
+  // num_points points. If derivs is not empty, only the polyset
+  // derivatives flagged in mask are computed, and the output holds the
+  // polyset derivatives with indices in derivs.
+  template <typename T>
+  void tabulate_tiles(int nd, const xtl::span<const int>& derivs,
+                      const xtl::span<const int>& mask,
+                      const xtl::span<const T>& coeffs,
+                      const xtl::span<const T>& x,
+                      std::size_t num_points, const xtl::span<T>& basis_data,
+                      std::size_t tile0, std::size_t tile1,
+                      TabulateWorkspace<T>& w, layout::type layout) const;
+
+  // Apply the precomputed transformation of variant v for orientation
+  // code of an entity with type index t (0 for an interval, 1 for a
+  // triangle and 2 for a quadrilateral) to the DOFs starting at
+  // dofstart
+  template <bool transpose_data, typename T>
+  void apply_entity_transformation(const xtl::span<T>& data, int block_size,
+                                   doftransform::type v, std::size_t t,
+                                   std::uint32_t code, int dofstart) const;
+
+  // Apply variant v of the transformations of the entities of the
+  // cell given by cell_info to data
+  template <bool transpose_data, typename T>
+  void apply_entity_transformations(const xtl::span<T>& data, int block_size,
+                                    std::uint32_t cell_info,
+                                    doftransform::type v) const;
+
+  // Apply variant v of the transformations of the entities of several
+  // cells to data. The cells are grouped by cell_info, so that the
+  // transformations for each orientation are looked up once for all the
+  // cells that share it.
+  template <bool transpose_data, typename T>
+  void apply_entity_transformations_batch(
+      const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+      int block_size, const xtl::span<const std::uint32_t>& cell_info,
+      doftransform::type v) const;
+
+  // The (entity type index, orientation code, first dof) of each entity
+  // of a cell with the given cell_info whose orientation code is not
+  // zero
+  std::vector<std::tuple<std::size_t, std::uint32_t, int>>
+  entity_orientations(std::uint32_t cell_info) const;
+
+  // Apply a DOF transformation matrix to data, using work as scratch
+  // memory
+  template <bool transpose_data, typename T>
+  static void apply_dof_transformation_matrix(const DofTransformationMatrix& M,
+                                              const xtl::span<T>& data,
+                                              int block_size,
+                                              std::vector<T>& work);
+
+  // The number of operations needed to transform the entities of a
+  // cell with the given cell_info
+  std::size_t entity_transformation_cost(std::uint32_t cell_info) const;
+
+  // The number of nonzeros in the DOF transformation matrix of a cell
+  // with the given cell_info, computed without building the matrix
+  std::size_t dof_transformation_matrix_nnz(std::uint32_t cell_info,
+                                            doftransform::type type) const;
+
+  // The cache used by FiniteElement::dof_transformation_matrix. A copy
+  // of an element gets its own cache, which starts with the size and
+  // the matrices of the cache of the original element.
+  struct DofTransformationCache
+  {
+    DofTransformationCache() = default;
+    DofTransformationCache(const DofTransformationCache& cache);
+    DofTransformationCache& operator=(const DofTransformationCache& cache);
+
+    mutable std::mutex mutex;
+
+    // The maximum number of matrices
+    std::size_t size = 0;
+
+    // The matrices for each (type, cell_info) key, and the keys in the
+    // order that the matrices were added
+    std::map<std::uint64_t, std::shared_ptr<const DofTransformationMatrix>>
+        matrices;
+    std::deque<std::uint64_t> order;
+  };
+
   // Cell type
   cell::type _cell_type;
 
@@ -638,6 +1361,19 @@ private:
   // (@f$\psi_{i}@f$).
   xt::xtensor<double, 2> _coeffs;
 
+  // _coeffs rounded to single precision, for tabulating in float
+  xt::xtensor<float, 2> _coeffs_float;
+
+  // Expansion coefficients of the one-dimensional factors of the basis
+  // functions in each direction for quadrilaterals and hexahedra, in
+  // terms of the 1D orthonormal polynomials. Empty if the basis does
+  // not factorise.
+  std::vector<xt::xtensor<double, 2>> _tensor_factor_coeffs;
+
+  // Index into _tensor_factor_coeffs[d] of the factor in direction d
+  // of each (dof, value component). -1 indicates a zero component.
+  xt::xtensor<int, 3> _tensor_factors;
+
   // Number of dofs associated with each cell (sub-)entity
   //
   // The dofs of an element are associated with entities of different
@@ -681,39 +1417,44 @@ private:
   /// Indicates whether or not the DOF transformations are all identity
   bool _dof_transformations_are_identity;
 
-  /// The entity permutations (factorised). This will only be set if
-  /// _dof_transformations_are_permutations is True and
-  /// _dof_transformations_are_identity is False
-  std::map<cell::type, std::vector<std::vector<std::size_t>>> _eperm;
-
-  /// The reverse entity permutations (factorised). This will only be set if
-  /// _dof_transformations_are_permutations is True and
-  /// _dof_transformations_are_identity is False
-  std::map<cell::type, std::vector<std::vector<std::size_t>>> _eperm_rev;
-
-  /// The entity transformations in precomputed form
-  std::map<cell::type,
-           std::vector<std::tuple<std::vector<std::size_t>, std::vector<double>,
-                                  xt::xtensor<double, 2>>>>
-      _etrans;
-
-  /// The transposed entity transformations in precomputed form
-  std::map<cell::type,
-           std::vector<std::tuple<std::vector<std::size_t>, std::vector<double>,
-                                  xt::xtensor<double, 2>>>>
-      _etransT;
-
-  /// The inverse entity transformations in precomputed form
-  std::map<cell::type,
-           std::vector<std::tuple<std::vector<std::size_t>, std::vector<double>,
-                                  xt::xtensor<double, 2>>>>
-      _etrans_inv;
-
-  /// The inverse transpose entity transformations in precomputed form
-  std::map<cell::type,
-           std::vector<std::tuple<std::vector<std::size_t>, std::vector<double>,
-                                  xt::xtensor<double, 2>>>>
-      _etrans_invT;
+  // The number of DOFs transformed by the transformations of an
+  // interval, a triangle and a quadrilateral
+  std::array<std::size_t, 3> _etrans_size;
+
+  // The offsets in _etrans_perm and _etrans_data of the precomputed
+  // entity transformations. The transformation of variant v for
+  // orientation code c of an entity with type index t is entry
+  // (4 * t + v) * 8 + c.
+  std::array<std::size_t, 96> _etrans_perm_offsets;
+  std::array<std::size_t, 96> _etrans_data_offsets;
+
+  // The number of nonzeros in each precomputed entity transformation,
+  // indexed as _etrans_perm_offsets
+  std::array<std::size_t, 96> _etrans_nnz;
+
+  // The permutations (factorised as in precompute::prepare_matrix) of
+  // the precomputed entity transformations. If the DOF transformations
+  // are permutations, these are the whole transformations.
+  std::vector<std::size_t> _etrans_perm;
+
+  // The diagonals and matrices (factorised as in
+  // precompute::prepare_matrix) of the precomputed entity
+  // transformations, packed contiguously. This is only set if the DOF
+  // transformations are not permutations.
+  std::vector<double> _etrans_data;
+
+  // The first DOF of each edge and face of the cell whose DOFs are
+  // transformed, and the type index of each face
+  std::vector<int> _edge_dofstart;
+  std::vector<int> _face_dofstart;
+  std::vector<std::size_t> _face_type;
+
+  // The bits of cell_info that change the DOF transformations, i.e.
+  // the bits of the edges and faces that have DOFs
+  std::uint32_t _cell_info_mask;
+
+  // The cache of DOF transformation matrices
+  mutable DofTransformationCache _dof_transformation_cache;
 };
 
 /// Create an element by name
@@ -723,383 +1464,456 @@ FiniteElement create_element(std::string family, std::string cell, int degree);
 FiniteElement create_element(element::family family, cell::type cell,
                              int degree);
 
+/// Create an element by name, or get it from a cache of elements
+/// that have already been created. See basix::create_element_cached.
+std::shared_ptr<const FiniteElement>
+create_element_cached(std::string family, std::string cell, int degree);
+
+/// Create an element, or get it from a cache of elements that have
+/// already been created. Creating an element is expensive, so this
+/// should be used when the same element is needed many times. The
+/// cache is shared by all threads, and this function can be called
+/// concurrently. Elements are kept in the cache until
+/// basix::clear_element_cache is called.
+/// @param[in] family The element family
+/// @param[in] cell The cell type
+/// @param[in] degree The degree of the element
+/// @return The element
+std::shared_ptr<const FiniteElement>
+create_element_cached(element::family family, cell::type cell, int degree);
+
+/// Statistics of the cache used by basix::create_element_cached
+struct ElementCacheStatistics
+{
+  /// The number of requests for an element that was in the cache
+  std::size_t hits;
+
+  /// The number of requests for an element that was not in the cache
+  std::size_t misses;
+
+  /// The number of elements in the cache
+  std::size_t size;
+
+  /// The number of requests for an element that was not in the cache
+  /// and was read from the cache directory
+  std::size_t disk_hits;
+};
+
+/// Get the statistics of the cache used by
+/// basix::create_element_cached since it was last cleared
+ElementCacheStatistics element_cache_statistics();
+
+/// Remove all elements from the cache used by
+/// basix::create_element_cached, and reset its statistics. Elements
+/// that have already been returned remain valid.
+void clear_element_cache();
+
+/// Set a directory in which basix::create_element_cached stores the
+/// elements that it creates, see FiniteElement::serialize. Elements
+/// that are not in memory are read from this directory if they have
+/// been stored by the same version of Basix, which is much faster than
+/// creating them. The directory must exist.
+/// @param[in] directory The directory. Use an empty string to stop
+/// using a directory.
+void set_element_cache_directory(const std::string& directory);
+
+/// Read an element written by FiniteElement::serialize
+/// @param[in] data The binary representation of the element
+/// @return The element
+FiniteElement deserialize_element(const xtl::span<const char>& data);
+
 /// Return the version number of basix across projects
 /// @return version string
 std::string version();
 
 //-----------------------------------------------------------------------------
-template <typename T>
-void FiniteElement::apply_dof_transformation(const xtl::span<T>& data,
-                                             int block_size,
-                                             std::uint32_t cell_info) const
+template <bool transpose_data, typename T>
+void FiniteElement::apply_entity_transformation(
+    const xtl::span<T>& data, int block_size, doftransform::type v,
+    std::size_t t, std::uint32_t code, int dofstart) const
 {
-  if (_dof_transformations_are_identity)
-    return;
-
-  if (_cell_tdim >= 2)
+  const std::size_t i = (4 * t + static_cast<std::size_t>(v)) * 8 + code;
+  const std::size_t n = _etrans_size[t];
+  const xtl::span<const std::size_t> perm(
+      _etrans_perm.data() + _etrans_perm_offsets[i], n);
+
+  // Permutations are applied directly, which avoids the O(n^2) cost of
+  // applying a matrix
+  if (_dof_transformations_are_permutations)
   {
-    // This assumes 3 bits are used per face. This will need updating if
-    // 3D cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
-
-    // Transform DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
+    if constexpr (transpose_data)
     {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_matrix(_etrans.at(cell::type::interval)[0], data,
-                                 dofstart, block_size);
-      dofstart += _num_edofs[1][e];
+      precompute::apply_permutation_to_transpose(perm, data, dofstart,
+                                                 block_size);
     }
-
-    if (_cell_tdim == 3)
+    else
+      precompute::apply_permutation(perm, data, dofstart, block_size);
+  }
+  else
+  {
+    const double* d = _etrans_data.data() + _etrans_data_offsets[i];
+    const xtl::span<const double> diag(d, n);
+    const xtl::span<const double> M(d + n, n * n);
+    if constexpr (transpose_data)
     {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
-      {
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_matrix(_etrans.at(_cell_subentity_types[2][f])[1],
-                                   data, dofstart, block_size);
-
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_matrix(_etrans.at(_cell_subentity_types[2][f])[0],
-                                   data, dofstart, block_size);
-        dofstart += _num_edofs[2][f];
-      }
+      precompute::apply_matrix_to_transpose(perm, diag, M, data, dofstart,
+                                            block_size);
     }
+    else
+      precompute::apply_matrix(perm, diag, M, data, dofstart, block_size);
   }
 }
 //-----------------------------------------------------------------------------
-template <typename T>
-void FiniteElement::apply_transpose_dof_transformation(
-    const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
+template <bool transpose_data, typename T>
+void FiniteElement::apply_entity_transformations(const xtl::span<T>& data,
+                                                 int block_size,
+                                                 std::uint32_t cell_info,
+                                                 doftransform::type v) const
 {
   if (_dof_transformations_are_identity)
     return;
 
-  if (_cell_tdim >= 2)
+  // This assumes 3 bits are used per face. This will need updating if
+  // 3D cells with faces with more than 4 sides are implemented
+  const std::size_t face_start = 3 * _face_dofstart.size();
+
+  // Transform DOFs on edges
+  for (std::size_t e = 0; e < _edge_dofstart.size(); ++e)
   {
-    // This assumes 3 bits are used per face. This will need updating if
-    // 3D cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
-
-    // Transform DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
+    // Reverse an edge
+    if (cell_info >> (face_start + e) & 1)
     {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_matrix(_etransT.at(cell::type::interval)[0], data,
-                                 dofstart, block_size);
-      dofstart += _num_edofs[1][e];
+      apply_entity_transformation<transpose_data>(data, block_size, v, 0, 1,
+                                                  _edge_dofstart[e]);
     }
+  }
 
-    if (_cell_tdim == 3)
+  // Transform DOFs on faces, with a single transformation for the
+  // reflection and rotations given by the 3-bit orientation code
+  for (std::size_t f = 0; f < _face_dofstart.size(); ++f)
+  {
+    if (std::uint32_t code = cell_info >> (3 * f) & 7; code != 0)
     {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
-      {
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_matrix(_etransT.at(_cell_subentity_types[2][f])[0],
-                                   data, dofstart, block_size);
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_matrix(_etransT.at(_cell_subentity_types[2][f])[1],
-                                   data, dofstart, block_size);
-        dofstart += _num_edofs[2][f];
-      }
+      apply_entity_transformation<transpose_data>(
+          data, block_size, v, _face_type[f], code, _face_dofstart[f]);
     }
   }
 }
 //-----------------------------------------------------------------------------
-template <typename T>
-void FiniteElement::apply_inverse_transpose_dof_transformation(
-    const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
+template <bool transpose_data, typename T>
+void FiniteElement::apply_dof_transformation_matrix(
+    const DofTransformationMatrix& M, const xtl::span<T>& data,
+    int block_size, std::vector<T>& work)
 {
-  if (_dof_transformations_are_identity)
-    return;
-
-  if (_cell_tdim >= 2)
+  const std::size_t ndofs = M.offsets.size() - 1;
+  if constexpr (transpose_data)
   {
-    // This assumes 3 bits are used per face. This will need updating if 3D
-    // cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
-
-    // Transform DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
+    // Multiply each row of the data by M
+    work.resize(ndofs);
+    for (int b = 0; b < block_size; ++b)
     {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_matrix(_etrans_invT.at(cell::type::interval)[0], data,
-                                 dofstart, block_size);
-      dofstart += _num_edofs[1][e];
+      T* x = data.data() + b * ndofs;
+      std::copy_n(x, ndofs, work.begin());
+      for (std::size_t i = 0; i < ndofs; ++i)
+      {
+        T v = 0;
+        for (std::int32_t k = M.offsets[i]; k < M.offsets[i + 1]; ++k)
+          v += M.values[k] * work[M.columns[k]];
+        x[i] = v;
+      }
     }
-
-    if (_cell_tdim == 3)
+  }
+  else
+  {
+    // Multiply the data, which has block_size columns, by M
+    work.assign(data.begin(), data.end());
+    for (std::size_t i = 0; i < ndofs; ++i)
     {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
+      T* y = data.data() + i * block_size;
+      std::fill_n(y, block_size, 0);
+      for (std::int32_t k = M.offsets[i]; k < M.offsets[i + 1]; ++k)
       {
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_matrix(
-              _etrans_invT.at(_cell_subentity_types[2][f])[1], data, dofstart,
-              block_size);
-
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_matrix(
-              _etrans_invT.at(_cell_subentity_types[2][f])[0], data, dofstart,
-              block_size);
-        dofstart += _num_edofs[2][f];
+        const T* x = work.data() + M.columns[k] * block_size;
+        for (int b = 0; b < block_size; ++b)
+          y[b] += M.values[k] * x[b];
       }
     }
   }
 }
 //-----------------------------------------------------------------------------
-template <typename T>
-void FiniteElement::apply_inverse_dof_transformation(
-    const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
+template <bool transpose_data, typename T>
+void FiniteElement::apply_entity_transformations_batch(
+    const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+    int block_size, const xtl::span<const std::uint32_t>& cell_info,
+    doftransform::type v) const
 {
+  const std::size_t cell_size = block_size * dim();
+  if (cell_info.size() != ncells)
+    throw std::runtime_error("cell_info has the wrong size.");
+  if (ncells > 0
+      and (stride < cell_size
+           or (ncells - 1) * stride + cell_size > data.size()))
+  {
+    throw std::runtime_error("Data has the wrong size.");
+  }
+
   if (_dof_transformations_are_identity)
     return;
 
-  if (_cell_tdim >= 2)
+  // Sort the cells by the bits of cell_info that change the
+  // transformation
+  const std::uint32_t mask = _cell_info_mask;
+  std::vector<std::size_t> cells(ncells);
+  std::iota(cells.begin(), cells.end(), 0);
+  std::sort(cells.begin(), cells.end(), [&cell_info, mask](auto c0, auto c1)
+            { return (cell_info[c0] & mask) < (cell_info[c1] & mask); });
+
+  // Use the cached matrices if the cache is enabled
+  const bool use_matrices = !_dof_transformations_are_permutations
+                            and dof_transformation_cache_size() > 0;
+  std::vector<T> work;
+
+  std::size_t c0 = 0;
+  while (c0 < ncells)
   {
-    // This assumes 3 bits are used per face. This will need updating if 3D
-    // cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
-
-    // Transform DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
+    // Find the cells [c0, c1) that share an orientation
+    const std::uint32_t info = cell_info[cells[c0]] & mask;
+    std::size_t c1 = c0 + 1;
+    while (c1 < ncells and (cell_info[cells[c1]] & mask) == info)
+      ++c1;
+
+    // Apply the matrix of the orientation to all of these cells if it
+    // needs fewer operations than transforming the entities. The matrix
+    // is only built (or taken from the cache) if it will be used.
+    if (use_matrices
+        and dof_transformation_matrix_nnz(info, v)
+                < entity_transformation_cost(info))
     {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_matrix(_etrans_inv.at(cell::type::interval)[0], data,
-                                 dofstart, block_size);
-      dofstart += _num_edofs[1][e];
+      std::shared_ptr<const DofTransformationMatrix> M
+          = dof_transformation_matrix(info, v);
+      for (std::size_t c = c0; c < c1; ++c)
+      {
+        apply_dof_transformation_matrix<transpose_data>(
+            *M, data.subspan(cells[c] * stride, cell_size), block_size,
+            work);
+      }
+
+      c0 = c1;
+      continue;
     }
 
-    if (_cell_tdim == 3)
+    // Apply the transformation of each entity to all of these cells
+    for (auto [t, code, dofstart] : entity_orientations(info))
     {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
+      for (std::size_t c = c0; c < c1; ++c)
       {
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_matrix(
-              _etrans_inv.at(_cell_subentity_types[2][f])[0], data, dofstart,
-              block_size);
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_matrix(
-              _etrans_inv.at(_cell_subentity_types[2][f])[1], data, dofstart,
-              block_size);
-        dofstart += _num_edofs[2][f];
+        apply_entity_transformation<transpose_data>(
+            data.subspan(cells[c] * stride, cell_size), block_size, v, t,
+            code, dofstart);
       }
     }
+
+    c0 = c1;
   }
 }
 //-----------------------------------------------------------------------------
 template <typename T>
+void FiniteElement::apply_dof_transformation(const xtl::span<T>& data,
+                                             int block_size,
+                                             std::uint32_t cell_info) const
+{
+  apply_entity_transformations<false>(data, block_size, cell_info,
+                                      doftransform::type::standard);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_transpose_dof_transformation(
+    const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
+{
+  apply_entity_transformations<false>(data, block_size, cell_info,
+                                      doftransform::type::transpose);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_inverse_transpose_dof_transformation(
+    const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
+{
+  apply_entity_transformations<false>(data, block_size, cell_info,
+                                      doftransform::type::inverse_transpose);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_inverse_dof_transformation(
+    const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
+{
+  apply_entity_transformations<false>(data, block_size, cell_info,
+                                      doftransform::type::inverse);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
 void FiniteElement::apply_dof_transformation_to_transpose(
     const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
 {
-  if (_dof_transformations_are_identity)
-    return;
-
-  if (_cell_tdim >= 2)
-  {
-    // This assumes 3 bits are used per face. This will need updating if
-    // 3D cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
-
-    // Transform DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
-    {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_matrix_to_transpose(
-            _etrans.at(cell::type::interval)[0], data, dofstart, block_size);
-      dofstart += _num_edofs[1][e];
-    }
-
-    if (_cell_tdim == 3)
-    {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
-      {
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_matrix_to_transpose(
-              _etrans.at(_cell_subentity_types[2][f])[1], data, dofstart,
-              block_size);
-
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_matrix_to_transpose(
-              _etrans.at(_cell_subentity_types[2][f])[0], data, dofstart,
-              block_size);
-        dofstart += _num_edofs[2][f];
-      }
-    }
-  }
+  apply_entity_transformations<true>(data, block_size, cell_info,
+                                     doftransform::type::standard);
 }
 //-----------------------------------------------------------------------------
 template <typename T>
 void FiniteElement::apply_inverse_transpose_dof_transformation_to_transpose(
     const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
 {
-  if (_dof_transformations_are_identity)
-    return;
-
-  if (_cell_tdim >= 2)
-  {
-    // This assumes 3 bits are used per face. This will need updating if
-    // 3D cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
-
-    // Transform DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
-    {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_matrix_to_transpose(
-            _etrans_invT.at(cell::type::interval)[0], data, dofstart,
-            block_size);
-      dofstart += _num_edofs[1][e];
-    }
-
-    if (_cell_tdim == 3)
-    {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
-      {
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_matrix_to_transpose(
-              _etrans_invT.at(_cell_subentity_types[2][f])[1], data, dofstart,
-              block_size);
-
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_matrix_to_transpose(
-              _etrans_invT.at(_cell_subentity_types[2][f])[0], data, dofstart,
-              block_size);
-        dofstart += _num_edofs[2][f];
-      }
-    }
-  }
+  apply_entity_transformations<true>(data, block_size, cell_info,
+                                     doftransform::type::inverse_transpose);
 }
 //-----------------------------------------------------------------------------
 template <typename T>
 void FiniteElement::apply_transpose_dof_transformation_to_transpose(
     const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
 {
-  if (_dof_transformations_are_identity)
-    return;
-
-  if (_cell_tdim >= 2)
-  {
-    // This assumes 3 bits are used per face. This will need updating if
-    // 3D cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
-
-    // Transform DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
-    {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_matrix_to_transpose(
-            _etransT.at(cell::type::interval)[0], data, dofstart, block_size);
-      dofstart += _num_edofs[1][e];
-    }
-
-    if (_cell_tdim == 3)
-    {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
-      {
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_matrix_to_transpose(
-              _etransT.at(_cell_subentity_types[2][f])[0], data, dofstart,
-              block_size);
-
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_matrix_to_transpose(
-              _etransT.at(_cell_subentity_types[2][f])[1], data, dofstart,
-              block_size);
-
-        dofstart += _num_edofs[2][f];
-      }
-    }
-  }
+  apply_entity_transformations<true>(data, block_size, cell_info,
+                                     doftransform::type::transpose);
 }
 //-----------------------------------------------------------------------------
 template <typename T>
 void FiniteElement::apply_inverse_dof_transformation_to_transpose(
     const xtl::span<T>& data, int block_size, std::uint32_t cell_info) const
 {
+  apply_entity_transformations<true>(data, block_size, cell_info,
+                                     doftransform::type::inverse);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_dof_transformation_batch(
+    const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+    int block_size, const xtl::span<const std::uint32_t>& cell_info) const
+{
+  apply_entity_transformations_batch<false>(
+      data, ncells, stride, block_size, cell_info,
+      doftransform::type::standard);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_transpose_dof_transformation_batch(
+    const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+    int block_size, const xtl::span<const std::uint32_t>& cell_info) const
+{
+  apply_entity_transformations_batch<false>(
+      data, ncells, stride, block_size, cell_info,
+      doftransform::type::transpose);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_inverse_transpose_dof_transformation_batch(
+    const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+    int block_size, const xtl::span<const std::uint32_t>& cell_info) const
+{
+  apply_entity_transformations_batch<false>(
+      data, ncells, stride, block_size, cell_info,
+      doftransform::type::inverse_transpose);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_inverse_dof_transformation_batch(
+    const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+    int block_size, const xtl::span<const std::uint32_t>& cell_info) const
+{
+  apply_entity_transformations_batch<false>(
+      data, ncells, stride, block_size, cell_info, doftransform::type::inverse);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_dof_transformation_to_transpose_batch(
+    const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+    int block_size, const xtl::span<const std::uint32_t>& cell_info) const
+{
+  apply_entity_transformations_batch<true>(
+      data, ncells, stride, block_size, cell_info,
+      doftransform::type::standard);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_transpose_dof_transformation_to_transpose_batch(
+    const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+    int block_size, const xtl::span<const std::uint32_t>& cell_info) const
+{
+  apply_entity_transformations_batch<true>(
+      data, ncells, stride, block_size, cell_info,
+      doftransform::type::transpose);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_inverse_transpose_dof_transformation_to_transpose_batch(
+    const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+    int block_size, const xtl::span<const std::uint32_t>& cell_info) const
+{
+  apply_entity_transformations_batch<true>(
+      data, ncells, stride, block_size, cell_info,
+      doftransform::type::inverse_transpose);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::apply_inverse_dof_transformation_to_transpose_batch(
+    const xtl::span<T>& data, std::size_t ncells, std::size_t stride,
+    int block_size, const xtl::span<const std::uint32_t>& cell_info) const
+{
+  apply_entity_transformations_batch<true>(
+      data, ncells, stride, block_size, cell_info, doftransform::type::inverse);
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void FiniteElement::transform_element_matrix(
+    const xtl::span<T>& A, const xtl::span<const std::uint32_t>& cell_info0,
+    const xtl::span<const std::uint32_t>& cell_info1, doftransform::type type,
+    int block_size) const
+{
+  const std::size_t n = dim() * block_size;
+  const std::size_t ncols = cell_info1.size() * n;
+  if (A.size() != cell_info0.size() * n * ncols)
+    throw std::runtime_error("A has the wrong size.");
+
   if (_dof_transformations_are_identity)
     return;
 
-  if (_cell_tdim >= 2)
+  // The entities to transform in each block of columns
+  std::vector<std::vector<std::tuple<std::size_t, std::uint32_t, int>>>
+      col_entities;
+  for (std::uint32_t c : cell_info1)
+    col_entities.push_back(entity_orientations(c));
+
+  // Transform the columns of rows [r0, r1) of A
+  auto transform_columns = [&](std::size_t r0, std::size_t r1)
   {
-    // This assumes 3 bits are used per face. This will need updating if
-    // 3D cells with faces with more than 4 sides are implemented
-    int face_start = _cell_tdim == 3 ? 3 * _num_edofs[2].size() : 0;
-    int dofstart
-        = std::accumulate(_num_edofs[0].cbegin(), _num_edofs[0].cend(), 0);
-
-    // Transform DOFs on edges
-    for (std::size_t e = 0; e < _num_edofs[1].size(); ++e)
+    for (std::size_t r = r0; r < r1; ++r)
     {
-      // Reverse an edge
-      if (cell_info >> (face_start + e) & 1)
-        precompute::apply_matrix_to_transpose(
-            _etrans_inv.at(cell::type::interval)[0], data, dofstart,
-            block_size);
-      dofstart += _num_edofs[1][e];
+      for (std::size_t j = 0; j < col_entities.size(); ++j)
+      {
+        xtl::span<T> row = A.subspan(r * ncols + j * n, n);
+        for (auto [t, code, dofstart] : col_entities[j])
+        {
+          apply_entity_transformation<false>(row, block_size, type, t, code,
+                                             dofstart);
+        }
+      }
     }
+  };
 
-    if (_cell_tdim == 3)
+  for (std::size_t i = 0; i < cell_info0.size(); ++i)
+  {
+    // Transform the rows of each entity, and then the columns of those
+    // rows and of the untransformed rows before them. The rows of each
+    // DOF are contiguous, so the block size of the row transformation
+    // is block_size * ncols.
+    xtl::span<T> Ai = A.subspan(i * n * ncols, n * ncols);
+    std::size_t r0 = 0;
+    for (auto [t, code, dofstart] : entity_orientations(cell_info0[i]))
     {
-      // Permute DOFs on faces
-      for (std::size_t f = 0; f < _num_edofs[2].size(); ++f)
-      {
-        // Rotate a face
-        for (std::uint32_t r = 0; r < (cell_info >> (3 * f + 1) & 3); ++r)
-          precompute::apply_matrix_to_transpose(
-              _etrans_inv.at(_cell_subentity_types[2][f])[0], data, dofstart,
-              block_size);
-
-        // Reflect a face
-        if (cell_info >> (3 * f) & 1)
-          precompute::apply_matrix_to_transpose(
-              _etrans_inv.at(_cell_subentity_types[2][f])[1], data, dofstart,
-              block_size);
-
-        dofstart += _num_edofs[2][f];
-      }
+      apply_entity_transformation<false>(Ai, block_size * ncols, type, t,
+                                         code, dofstart);
+      const std::size_t r1 = (dofstart + _etrans_size[t]) * block_size;
+      transform_columns(i * n + r0, i * n + r1);
+      r0 = r1;
     }
+    transform_columns(i * n + r0, (i + 1) * n);
   }
 }
 //-----------------------------------------------------------------------------
@@ -3,8 +3,169 @@
 // SPDX-License-Identifier:    MIT
 
 #include "maps.h"
+#include "indexing.h"
+#include <algorithm>
 #include <map>
 #include <stdexcept>
+#include <vector>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+template <basix::maps::type map_type, std::size_t gdim>
+basix::maps::kernel_type get_kernel_tdim(std::size_t tdim)
+{
+  switch (tdim)
+  {
+  case 1:
+    return &basix::maps::impl::piola<map_type, gdim, 1>;
+  case 2:
+    return &basix::maps::impl::piola<map_type, gdim, 2>;
+  case 3:
+    return &basix::maps::impl::piola<map_type, gdim, 3>;
+  default:
+    throw std::runtime_error("Unsupported topological dimension");
+  }
+}
+//-----------------------------------------------------------------------------
+template <basix::maps::type map_type>
+basix::maps::kernel_type get_kernel_gdim(std::size_t gdim, std::size_t tdim)
+{
+  switch (gdim)
+  {
+  case 1:
+    return get_kernel_tdim<map_type, 1>(tdim);
+  case 2:
+    return get_kernel_tdim<map_type, 2>(tdim);
+  case 3:
+    return get_kernel_tdim<map_type, 3>(tdim);
+  default:
+    throw std::runtime_error("Unsupported geometric dimension");
+  }
+}
+//-----------------------------------------------------------------------------
+
+// A value and its first and second derivatives with respect to the
+// reference coordinates. Arithmetic is truncated at second order.
+struct jet
+{
+  double v = 0.0;
+  std::array<double, 3> d = {};
+  std::array<double, 9> h = {};
+};
+//-----------------------------------------------------------------------------
+jet operator+(jet a, const jet& b)
+{
+  a.v += b.v;
+  for (std::size_t k = 0; k < 3; ++k)
+    a.d[k] += b.d[k];
+  for (std::size_t k = 0; k < 9; ++k)
+    a.h[k] += b.h[k];
+  return a;
+}
+//-----------------------------------------------------------------------------
+jet operator-(jet a, const jet& b)
+{
+  a.v -= b.v;
+  for (std::size_t k = 0; k < 3; ++k)
+    a.d[k] -= b.d[k];
+  for (std::size_t k = 0; k < 9; ++k)
+    a.h[k] -= b.h[k];
+  return a;
+}
+//-----------------------------------------------------------------------------
+jet operator*(const jet& a, const jet& b)
+{
+  jet c;
+  c.v = a.v * b.v;
+  for (std::size_t k = 0; k < 3; ++k)
+    c.d[k] = a.d[k] * b.v + a.v * b.d[k];
+  for (std::size_t k = 0; k < 3; ++k)
+  {
+    for (std::size_t l = 0; l < 3; ++l)
+    {
+      c.h[k * 3 + l] = a.h[k * 3 + l] * b.v + a.d[k] * b.d[l]
+                       + a.d[l] * b.d[k] + a.v * b.h[k * 3 + l];
+    }
+  }
+  return c;
+}
+//-----------------------------------------------------------------------------
+jet reciprocal(const jet& a)
+{
+  jet c;
+  c.v = 1.0 / a.v;
+  for (std::size_t k = 0; k < 3; ++k)
+    c.d[k] = -a.d[k] * c.v * c.v;
+  for (std::size_t k = 0; k < 3; ++k)
+  {
+    for (std::size_t l = 0; l < 3; ++l)
+    {
+      c.h[k * 3 + l] = (-a.h[k * 3 + l]
+                        + 2.0 * a.d[k] * a.d[l] * c.v)
+                       * c.v * c.v;
+    }
+  }
+  return c;
+}
+//-----------------------------------------------------------------------------
+
+// A matrix of jets with at most three rows and columns, row-major
+using jet_matrix = std::array<jet, 9>;
+//-----------------------------------------------------------------------------
+// C = A B, where A has shape (m, k) and B has shape (k, n)
+jet_matrix matmul(const jet_matrix& A, const jet_matrix& B, std::size_t m,
+                  std::size_t k, std::size_t n)
+{
+  jet_matrix C;
+  for (std::size_t i = 0; i < m; ++i)
+    for (std::size_t j = 0; j < n; ++j)
+      for (std::size_t l = 0; l < k; ++l)
+        C[i * n + j] = C[i * n + j] + A[i * k + l] * B[l * n + j];
+  return C;
+}
+//-----------------------------------------------------------------------------
+// Inverse of the (n, n) matrix M, given the inverse N0 of its value.
+// Writing M = M0 + E, where E has value zero, the series N0 - N0 E N0 +
+// N0 E N0 E N0 is exact at second order.
+jet_matrix inverse(const jet_matrix& M, const jet_matrix& N0, std::size_t n)
+{
+  jet_matrix E = M;
+  for (std::size_t i = 0; i < n * n; ++i)
+    E[i].v = 0.0;
+  const jet_matrix N0E = matmul(N0, E, n, n, n);
+  const jet_matrix N0EN0 = matmul(N0E, N0, n, n, n);
+  const jet_matrix N0EN0EN0 = matmul(N0E, N0EN0, n, n, n);
+  jet_matrix N;
+  for (std::size_t i = 0; i < n * n; ++i)
+    N[i] = N0[i] - N0EN0[i] + N0EN0EN0[i];
+  return N;
+}
+//-----------------------------------------------------------------------------
+// Index of the derivative with multi-index c in a table of derivatives
+// in dim dimensions, ordered as in FiniteElement::tabulate
+int derivative_index(std::size_t dim, const std::array<int, 3>& c)
+{
+  switch (dim)
+  {
+  case 1:
+    return basix::idx(c[0]);
+  case 2:
+    return basix::idx(c[0], c[1]);
+  default:
+    return basix::idx(c[0], c[1], c[2]);
+  }
+}
+//-----------------------------------------------------------------------------
+// Number of derivatives of order up to nd in dim dimensions
+std::size_t num_derivatives(std::size_t dim, int nd)
+{
+  std::array<int, 3> c = {0, 0, 0};
+  c[dim - 1] = nd;
+  return derivative_index(dim, c) + 1;
+}
+//-----------------------------------------------------------------------------
+} // namespace
 
 //-----------------------------------------------------------------------------
 const std::string& basix::maps::type_to_str(maps::type type)
@@ -23,3 +184,381 @@ const std::string& basix::maps::type_to_str(maps::type type)
   return it->second;
 }
 //-----------------------------------------------------------------------------
+xt::xtensor<double, 2>
+basix::maps::affine_map_matrix(const xt::xtensor<double, 2>& J, double detJ,
+                               const xt::xtensor<double, 2>& K,
+                               maps::type map_type)
+{
+  // J has shape (gdim, tdim) and K has shape (tdim, gdim)
+  const std::size_t gdim = J.shape(0);
+  const std::size_t tdim = J.shape(1);
+  switch (map_type)
+  {
+  case maps::type::covariantPiola:
+  {
+    // u = K^T U
+    return xt::transpose(K);
+  }
+  case maps::type::contravariantPiola:
+  {
+    // u = J U / detJ
+    return J / detJ;
+  }
+  case maps::type::doubleCovariantPiola:
+  {
+    // u = K^T U K, so u_ij = K_ki K_lj U_kl
+    xt::xtensor<double, 2> A({gdim * gdim, tdim * tdim});
+    for (std::size_t i = 0; i < gdim; ++i)
+      for (std::size_t j = 0; j < gdim; ++j)
+        for (std::size_t k = 0; k < tdim; ++k)
+          for (std::size_t l = 0; l < tdim; ++l)
+            A(i * gdim + j, k * tdim + l) = K(k, i) * K(l, j);
+    return A;
+  }
+  case maps::type::doubleContravariantPiola:
+  {
+    // u = J U J^T / detJ^2, so u_ij = J_ik J_jl U_kl / detJ^2
+    xt::xtensor<double, 2> A({gdim * gdim, tdim * tdim});
+    for (std::size_t i = 0; i < gdim; ++i)
+      for (std::size_t j = 0; j < gdim; ++j)
+        for (std::size_t k = 0; k < tdim; ++k)
+          for (std::size_t l = 0; l < tdim; ++l)
+            A(i * gdim + j, k * tdim + l) = J(i, k) * J(j, l) / (detJ * detJ);
+    return A;
+  }
+  default:
+    throw std::runtime_error("Mapping has no matrix");
+  }
+}
+//-----------------------------------------------------------------------------
+basix::maps::kernel_type basix::maps::get_kernel(maps::type map_type,
+                                                std::size_t gdim,
+                                                std::size_t tdim)
+{
+  switch (map_type)
+  {
+  case maps::type::covariantPiola:
+    return get_kernel_gdim<maps::type::covariantPiola>(gdim, tdim);
+  case maps::type::contravariantPiola:
+    return get_kernel_gdim<maps::type::contravariantPiola>(gdim, tdim);
+  case maps::type::doubleCovariantPiola:
+    return get_kernel_gdim<maps::type::doubleCovariantPiola>(gdim, tdim);
+  case maps::type::doubleContravariantPiola:
+    return get_kernel_gdim<maps::type::doubleContravariantPiola>(gdim, tdim);
+  default:
+    throw std::runtime_error("Mapping has no kernel");
+  }
+}
+//-----------------------------------------------------------------------------
+void basix::maps::push_forward_derivatives(
+    maps::type map_type, int nd, const xtl::span<const double>& U,
+    std::array<std::size_t, 4> Ushape, const xtl::span<const double>& J,
+    std::array<std::size_t, 2> Jshape, const xtl::span<const double>& detJ,
+    const xtl::span<const double>& K, const xtl::span<const double>& dJ,
+    const xtl::span<double>& u)
+{
+  if (nd < 0 or nd > 2)
+    throw std::runtime_error("Unsupported order of derivatives");
+
+  const std::size_t num_points = Ushape[1];
+  const std::size_t nfn = Ushape[2];
+  const std::size_t gdim = Jshape[0];
+  const std::size_t tdim = Jshape[1];
+  if (tdim < 1 or gdim > 3 or tdim > gdim)
+    throw std::runtime_error("Unsupported dimensions");
+
+  const std::size_t nref = num_derivatives(tdim, nd);
+  const std::size_t nphys = num_derivatives(gdim, nd);
+  if (Ushape[0] != nref
+      or U.size() != Ushape[0] * Ushape[1] * Ushape[2] * Ushape[3])
+  {
+    throw std::runtime_error("Reference data array has the wrong shape.");
+  }
+  const std::size_t jsize = gdim * tdim;
+  if (J.size() != num_points * jsize or K.size() != J.size()
+      or detJ.size() != num_points)
+  {
+    throw std::runtime_error("Jacobian arrays have the wrong shape.");
+  }
+
+  // Without derivatives of J, the geometry is affine, and the terms
+  // with derivatives of J vanish
+  const bool affine = dJ.empty();
+  if (!affine and dJ.size() != (nref - 1) * J.size())
+    throw std::runtime_error("Jacobian derivative array has the wrong shape.");
+
+  // On a curved manifold, the second tangential derivatives are not
+  // symmetric, so do not fit the table of derivatives
+  if (nd > 1 and !affine and gdim != tdim)
+  {
+    throw std::runtime_error(
+        "Second derivatives on a non-affine manifold are not supported");
+  }
+
+  // The value sizes on the reference (C) and on the physical cell (R)
+  std::size_t C, R;
+  switch (map_type)
+  {
+  case maps::type::identity:
+    C = Ushape[3];
+    R = C;
+    break;
+  case maps::type::covariantPiola:
+  case maps::type::contravariantPiola:
+    C = tdim;
+    R = gdim;
+    break;
+  case maps::type::doubleCovariantPiola:
+  case maps::type::doubleContravariantPiola:
+    C = tdim * tdim;
+    R = gdim * gdim;
+    break;
+  default:
+    throw std::runtime_error("Mapping not yet implemented");
+  }
+  if (Ushape[3] != C)
+    throw std::runtime_error("Reference value size does not match the map.");
+  if (u.size() != nphys * num_points * nfn * R)
+    throw std::runtime_error("Physical data array has the wrong shape.");
+
+  // Indices of the first derivative in direction k and the second
+  // derivative in directions k and l, in a table of derivatives in dim
+  // dimensions
+  auto index1 = [](std::size_t dim, std::size_t k)
+  {
+    std::array<int, 3> c = {0, 0, 0};
+    ++c[k];
+    return derivative_index(dim, c);
+  };
+  auto index2 = [](std::size_t dim, std::size_t k, std::size_t l)
+  {
+    std::array<int, 3> c = {0, 0, 0};
+    ++c[k];
+    ++c[l];
+    return derivative_index(dim, c);
+  };
+
+  // The matrix of the map at a point, and its derivatives with respect
+  // to the reference coordinates
+  std::vector<double> A(R * C), dA(tdim * R * C), hA(tdim * tdim * R * C);
+  auto set_A = [&](std::size_t r, std::size_t c, const jet& a)
+  {
+    A[r * C + c] = a.v;
+    for (std::size_t k = 0; k < tdim; ++k)
+    {
+      dA[(k * R + r) * C + c] = a.d[k];
+      for (std::size_t l = 0; l < tdim; ++l)
+        hA[((k * tdim + l) * R + r) * C + c] = a.h[k * 3 + l];
+    }
+  };
+
+  // y += M x, for M with shape (R, C)
+  auto gemv = [R, C](const double* M, const double* x, double* y)
+  {
+    for (std::size_t r = 0; r < R; ++r)
+      for (std::size_t c = 0; c < C; ++c)
+        y[r] += M[r * C + c] * x[c];
+  };
+
+  // Derivatives of the mapped value of a function with respect to the
+  // reference coordinates
+  std::vector<double> w0(R), w1(tdim * R), w2(tdim * tdim * R);
+
+  for (std::size_t p = 0; p < num_points; ++p)
+  {
+    // J and K as jets
+    jet_matrix Jp, Kp;
+    for (std::size_t i = 0; i < jsize; ++i)
+    {
+      Jp[i].v = J[p * jsize + i];
+      Kp[i].v = K[p * jsize + i];
+    }
+
+    jet detj;
+    detj.v = detJ[p];
+    if (!affine)
+    {
+      for (std::size_t i = 0; i < jsize; ++i)
+      {
+        for (std::size_t k = 0; k < tdim; ++k)
+        {
+          Jp[i].d[k] = dJ[((index1(tdim, k) - 1) * num_points + p) * jsize + i];
+          for (std::size_t l = 0; l < tdim and nd > 1; ++l)
+          {
+            Jp[i].h[k * 3 + l]
+                = dJ[((index2(tdim, k, l) - 1) * num_points + p) * jsize + i];
+          }
+        }
+      }
+
+      // K = (J^T J)^{-1} J^T, and the inverse of the value of J^T J is
+      // K K^T
+      jet_matrix Jt, G0inv;
+      for (std::size_t i = 0; i < gdim; ++i)
+        for (std::size_t k = 0; k < tdim; ++k)
+          Jt[k * gdim + i] = Jp[i * tdim + k];
+      for (std::size_t k = 0; k < tdim; ++k)
+        for (std::size_t l = 0; l < tdim; ++l)
+          for (std::size_t i = 0; i < gdim; ++i)
+            G0inv[k * tdim + l].v += Kp[k * gdim + i].v * Kp[l * gdim + i].v;
+      const jet_matrix G = matmul(Jt, Jp, tdim, gdim, tdim);
+      Kp = matmul(inverse(G, G0inv, tdim), Jt, tdim, tdim, gdim);
+
+      // The derivative of detJ is detJ tr(K dJ)
+      std::array<double, 3> t = {0.0, 0.0, 0.0};
+      for (std::size_t k = 0; k < tdim; ++k)
+        for (std::size_t m = 0; m < tdim; ++m)
+          for (std::size_t i = 0; i < gdim; ++i)
+            t[k] += Kp[m * gdim + i].v * Jp[i * tdim + m].d[k];
+      for (std::size_t k = 0; k < tdim; ++k)
+        detj.d[k] = detJ[p] * t[k];
+      for (std::size_t k = 0; k < tdim; ++k)
+      {
+        for (std::size_t l = 0; l < tdim; ++l)
+        {
+          double dt = 0.0;
+          for (std::size_t m = 0; m < tdim; ++m)
+          {
+            for (std::size_t i = 0; i < gdim; ++i)
+            {
+              dt += Kp[m * gdim + i].d[l] * Jp[i * tdim + m].d[k]
+                    + Kp[m * gdim + i].v * Jp[i * tdim + m].h[k * 3 + l];
+            }
+          }
+          detj.h[k * 3 + l] = detj.d[l] * t[k] + detJ[p] * dt;
+        }
+      }
+    }
+
+    // The matrix of the map
+    switch (map_type)
+    {
+    case maps::type::identity:
+      for (std::size_t r = 0; r < R; ++r)
+      {
+        jet a;
+        for (std::size_t c = 0; c < C; ++c)
+        {
+          a.v = r == c ? 1.0 : 0.0;
+          set_A(r, c, a);
+        }
+      }
+      break;
+    case maps::type::covariantPiola:
+      // u = K^T U
+      for (std::size_t i = 0; i < gdim; ++i)
+        for (std::size_t k = 0; k < tdim; ++k)
+          set_A(i, k, Kp[k * gdim + i]);
+      break;
+    case maps::type::contravariantPiola:
+    {
+      // u = J U / detJ
+      const jet s = reciprocal(detj);
+      for (std::size_t i = 0; i < gdim; ++i)
+        for (std::size_t k = 0; k < tdim; ++k)
+          set_A(i, k, Jp[i * tdim + k] * s);
+      break;
+    }
+    case maps::type::doubleCovariantPiola:
+      // u = K^T U K
+      for (std::size_t i = 0; i < gdim; ++i)
+        for (std::size_t j = 0; j < gdim; ++j)
+          for (std::size_t k = 0; k < tdim; ++k)
+            for (std::size_t l = 0; l < tdim; ++l)
+              set_A(i * gdim + j, k * tdim + l,
+                    Kp[k * gdim + i] * Kp[l * gdim + j]);
+      break;
+    case maps::type::doubleContravariantPiola:
+    {
+      // u = J U J^T / detJ^2
+      const jet s = reciprocal(detj);
+      const jet s2 = s * s;
+      for (std::size_t i = 0; i < gdim; ++i)
+        for (std::size_t j = 0; j < gdim; ++j)
+          for (std::size_t k = 0; k < tdim; ++k)
+            for (std::size_t l = 0; l < tdim; ++l)
+              set_A(i * gdim + j, k * tdim + l,
+                    Jp[i * tdim + k] * Jp[j * tdim + l] * s2);
+      break;
+    }
+    default:
+      throw std::runtime_error("Mapping not yet implemented");
+    }
+
+    for (std::size_t f = 0; f < nfn; ++f)
+    {
+      auto U_d = [&](std::size_t d)
+      { return U.data() + ((d * num_points + p) * nfn + f) * C; };
+      auto u_d = [&](std::size_t d)
+      { return u.data() + ((d * num_points + p) * nfn + f) * R; };
+
+      // Differentiate u = A U with respect to the reference coordinates
+      std::fill(w0.begin(), w0.end(), 0.0);
+      gemv(A.data(), U_d(0), w0.data());
+      std::copy(w0.begin(), w0.end(), u_d(0));
+      if (nd == 0)
+        continue;
+
+      std::fill(w1.begin(), w1.end(), 0.0);
+      for (std::size_t k = 0; k < tdim; ++k)
+      {
+        gemv(A.data(), U_d(index1(tdim, k)), w1.data() + k * R);
+        if (!affine)
+          gemv(dA.data() + k * R * C, U_d(0), w1.data() + k * R);
+      }
+
+      if (nd > 1)
+      {
+        std::fill(w2.begin(), w2.end(), 0.0);
+        for (std::size_t k = 0; k < tdim; ++k)
+        {
+          for (std::size_t l = 0; l < tdim; ++l)
+          {
+            double* w_kl = w2.data() + (k * tdim + l) * R;
+            gemv(A.data(), U_d(index2(tdim, k, l)), w_kl);
+            if (!affine)
+            {
+              gemv(hA.data() + (k * tdim + l) * R * C, U_d(0), w_kl);
+              gemv(dA.data() + k * R * C, U_d(index1(tdim, l)), w_kl);
+              gemv(dA.data() + l * R * C, U_d(index1(tdim, k)), w_kl);
+            }
+          }
+        }
+      }
+
+      // Apply the chain rule, d/dx_j = K_kj d/dX_k
+      for (std::size_t j = 0; j < gdim; ++j)
+      {
+        double* out = u_d(index1(gdim, j));
+        std::fill_n(out, R, 0.0);
+        for (std::size_t k = 0; k < tdim; ++k)
+          for (std::size_t r = 0; r < R; ++r)
+            out[r] += Kp[k * gdim + j].v * w1[k * R + r];
+      }
+
+      if (nd > 1)
+      {
+        // d2/dx_i dx_j = K_li d/dX_l (K_kj d/dX_k)
+        for (std::size_t i = 0; i < gdim; ++i)
+        {
+          for (std::size_t j = i; j < gdim; ++j)
+          {
+            double* out = u_d(index2(gdim, i, j));
+            std::fill_n(out, R, 0.0);
+            for (std::size_t l = 0; l < tdim; ++l)
+            {
+              for (std::size_t k = 0; k < tdim; ++k)
+              {
+                const double a = Kp[l * gdim + i].v * Kp[k * gdim + j].v;
+                const double b = Kp[l * gdim + i].v * Kp[k * gdim + j].d[l];
+                for (std::size_t r = 0; r < R; ++r)
+                  out[r] += a * w2[(l * tdim + k) * R + r] + b * w1[k * R + r];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+//-----------------------------------------------------------------------------
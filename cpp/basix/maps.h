@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <array>
 #include <stdexcept>
 #include <string>
 #include <xtensor/xadapt.hpp>
@@ -28,6 +29,23 @@ enum class type
 /// Convert mapping type enum to string
 const std::string& type_to_str(maps::type type);
 
+/// Compute the matrix of a map on a cell with an affine geometry. On
+/// such a cell, J, detJ and K are the same at every point, and the map
+/// takes the value U of a function at any point (flattened with
+/// row-major layout) to A U. For the matrix of the inverse map, pass K,
+/// 1 / detJ and J in place of J, detJ and K.
+///
+/// @param[in] J Jacobian of the map
+/// @param[in] detJ Determinant of `J`
+/// @param[in] K The inverse of `J`
+/// @param[in] map_type The map type. This must not be
+/// maps::type::identity, as its matrix depends on the value size
+/// @return The matrix A, with shape (mapped value size, value size)
+xt::xtensor<double, 2> affine_map_matrix(const xt::xtensor<double, 2>& J,
+                                         double detJ,
+                                         const xt::xtensor<double, 2>& K,
+                                         maps::type map_type);
+
 namespace impl
 {
 template <typename O, typename Mat0, typename Mat1, typename Mat2>
@@ -114,6 +132,76 @@ void double_contravariant_piola(O& r, const P& U, const Q& J, double detJ,
   }
   r /= (detJ * detJ);
 }
+
+// Apply the matrix A, with shape (R, C), to the values at n points,
+// u_p = A U_p
+template <std::size_t R, std::size_t C>
+void apply_matrix(std::size_t n, const std::array<double, R * C>& A,
+                  const double* U, double* u)
+{
+  for (std::size_t p = 0; p < n; ++p)
+  {
+    const double* U_p = U + p * C;
+    double* u_p = u + p * R;
+    for (std::size_t r = 0; r < R; ++r)
+    {
+      double v = 0;
+      for (std::size_t c = 0; c < C; ++c)
+        v += A[r * C + c] * U_p[c];
+      u_p[r] = v;
+    }
+  }
+}
+
+// Apply a Piola map with compile-time type and dimensions to the values
+// at n points that share J, detJ and K. The map is linear, so its
+// matrix is computed once and then applied to the value at each point.
+template <maps::type map_type, std::size_t gdim, std::size_t tdim>
+void piola(std::size_t n, const double* U, const double* J, double detJ,
+           const double* K, double* u)
+{
+  if constexpr (map_type == maps::type::covariantPiola)
+  {
+    // u = K^T U
+    std::array<double, gdim * tdim> A;
+    for (std::size_t i = 0; i < gdim; ++i)
+      for (std::size_t k = 0; k < tdim; ++k)
+        A[i * tdim + k] = K[k * gdim + i];
+    apply_matrix<gdim, tdim>(n, A, U, u);
+  }
+  else if constexpr (map_type == maps::type::contravariantPiola)
+  {
+    // u = J U / detJ
+    std::array<double, gdim * tdim> A;
+    for (std::size_t i = 0; i < gdim * tdim; ++i)
+      A[i] = J[i] / detJ;
+    apply_matrix<gdim, tdim>(n, A, U, u);
+  }
+  else if constexpr (map_type == maps::type::doubleCovariantPiola)
+  {
+    // u = K^T U K
+    std::array<double, gdim * gdim * tdim * tdim> A;
+    for (std::size_t i = 0; i < gdim; ++i)
+      for (std::size_t j = 0; j < gdim; ++j)
+        for (std::size_t k = 0; k < tdim; ++k)
+          for (std::size_t l = 0; l < tdim; ++l)
+            A[(i * gdim + j) * tdim * tdim + k * tdim + l]
+                = K[k * gdim + i] * K[l * gdim + j];
+    apply_matrix<gdim * gdim, tdim * tdim>(n, A, U, u);
+  }
+  else if constexpr (map_type == maps::type::doubleContravariantPiola)
+  {
+    // u = J U J^T / detJ^2
+    std::array<double, gdim * gdim * tdim * tdim> A;
+    for (std::size_t i = 0; i < gdim; ++i)
+      for (std::size_t j = 0; j < gdim; ++j)
+        for (std::size_t k = 0; k < tdim; ++k)
+          for (std::size_t l = 0; l < tdim; ++l)
+            A[(i * gdim + j) * tdim * tdim + k * tdim + l]
+                = J[i * tdim + k] * J[j * tdim + l] / (detJ * detJ);
+    apply_matrix<gdim * gdim, tdim * tdim>(n, A, U, u);
+  }
+}
 } // namespace impl
 
 /// Apply a map to data. Note that the required input arguments depends
@@ -147,4 +235,67 @@ void apply_map(O&& u, const P& U, const Mat0& J, double detJ, const Mat1& K,
   }
 }
 
+/// A kernel that applies a map to the values at n points that share J,
+/// detJ and K. The arguments are (n, U, J, detJ, K, u). All the arrays
+/// are contiguous and row-major: U has shape (n, reference value size),
+/// J has shape (gdim, tdim), K has shape (tdim, gdim) and u has shape
+/// (n, physical value size).
+using kernel_type = void (*)(std::size_t, const double*, const double*,
+                             double, const double*, double*);
+
+/// Get a kernel that applies a map, in which the map type and the
+/// dimensions are compile-time constants. Call this once, and then call
+/// the kernel for each set of points that share a Jacobian.
+///
+/// For the inverse map, call the kernel with K, 1 / detJ and J in place
+/// of J, detJ and K, and swap gdim and tdim.
+///
+/// @param[in] map_type The map type. This must not be
+/// maps::type::identity, as the kernel depends on the value size
+/// @param[in] gdim The geometric dimension (1, 2 or 3)
+/// @param[in] tdim The topological dimension (1, 2 or 3)
+/// @return The kernel
+kernel_type get_kernel(maps::type map_type, std::size_t gdim,
+                       std::size_t tdim);
+
+/// Map values, and their first and second derivatives, from the
+/// reference to a physical cell. The derivatives of the mapped values
+/// with respect to the physical coordinates follow from the chain rule,
+/// and include the derivatives of J, detJ and K on cells with a
+/// non-affine geometry. On a manifold (gdim > tdim) they are the
+/// tangential derivatives, and second derivatives are only supported
+/// on cells with an affine geometry.
+///
+/// The derivatives are ordered as in FiniteElement::tabulate, for
+/// tdim coordinates on the reference and gdim coordinates on the
+/// physical cell. All arrays are row-major.
+///
+/// @param[in] map_type The map type
+/// @param[in] nd The order of derivatives (0, 1 or 2)
+/// @param[in] U The values and derivatives on the reference
+/// @param[in] Ushape The shape of @p U, i.e. (derivative, point,
+/// function, reference value size)
+/// @param[in] J The Jacobian at each point
+/// @param[in] Jshape The shape of the Jacobian at a point, i.e. (gdim,
+/// tdim)
+/// @param[in] detJ The determinant of J at each point
+/// @param[in] K The inverse of J at each point, with shape (point,
+/// tdim, gdim)
+/// @param[in] dJ The derivatives of J of order 1 to @p nd with respect
+/// to the reference coordinates, with shape (derivative, point, gdim,
+/// tdim), omitting the zeroth derivative. Pass an empty array for a
+/// cell with an affine geometry, to skip the terms with derivatives
+/// of J.
+/// @param[out] u The mapped values and derivatives, with shape
+/// (derivative, point, function, physical value size)
+void push_forward_derivatives(maps::type map_type, int nd,
+                              const xtl::span<const double>& U,
+                              std::array<std::size_t, 4> Ushape,
+                              const xtl::span<const double>& J,
+                              std::array<std::size_t, 2> Jshape,
+                              const xtl::span<const double>& detJ,
+                              const xtl::span<const double>& K,
+                              const xtl::span<const double>& dJ,
+                              const xtl::span<double>& u);
+
 } // namespace basix::maps
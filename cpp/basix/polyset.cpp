@@ -7,7 +7,9 @@
 #include "indexing.h"
 #include <array>
 #include <cmath>
+#include <vector>
 #include <xtensor/xadapt.hpp>
+#include <xtensor/xnoalias.hpp>
 #include <xtensor/xview.hpp>
 
 using namespace basix;
@@ -26,21 +28,44 @@ constexpr std::array<double, 3> jrc(int a, int n)
   return {an, bn, cn};
 }
 //-----------------------------------------------------------------------------
+// Check if derivative i is needed. The mask is either empty, in which
+// case all derivatives are needed, or has one entry for each
+// derivative, which is nonzero if it is needed.
+bool needed(const xtl::span<const int>& mask, std::size_t i)
+{
+  return mask.empty() or mask[i];
+}
+//-----------------------------------------------------------------------------
+// View a workspace buffer as a table of the given shape. The buffer
+// keeps its capacity when a smaller table is needed, e.g. for the last
+// tile of points, so it is only reallocated when it grows.
+template <typename T>
+auto factor_table(std::vector<T>& buffer, std::array<std::size_t, 3> shape)
+{
+  buffer.resize(shape[0] * shape[1] * shape[2]);
+  return xt::adapt(buffer.data(), buffer.size(), xt::no_ownership(), shape);
+}
+//-----------------------------------------------------------------------------
 // Compute the complete set of derivatives from 0 to nderiv, for all the
 // polynomials up to order n on a line segment. The polynomials used are
 // Legendre Polynomials, with the recurrence relation given by
 // n P(n) = (2n - 1) x P_{n-1} - (n - 1) P_{n-2} in the interval [-1, 1]. The
 // range is rescaled here to [0, 1].
-xt::xtensor<double, 3>
-tabulate_polyset_line_derivs(std::size_t degree, std::size_t nderiv,
-                             const xt::xtensor<double, 1>& x)
+template <typename P_t, typename X_t>
+void tabulate_polyset_line_derivs(P_t& P, std::size_t degree,
+                                  std::size_t nderiv, const X_t& x,
+                                  const xtl::span<const int>& mask = {})
 {
   assert(x.shape(0) > 0);
+  assert(P.shape(0) == nderiv + 1);
+  assert(P.shape(1) == x.shape(0));
+  assert(P.shape(2) == degree + 1);
   const auto X = x * 2.0 - 1.0;
-  const std::size_t m = (degree + 1);
-  xt::xtensor<double, 3> P({nderiv + 1, x.shape(0), m});
   for (std::size_t k = 0; k <= nderiv; ++k)
   {
+    if (!needed(mask, k))
+      continue;
+
     // Get reference to this derivative
     auto result = xt::view(P, k, xt::all(), xt::all());
     if (k == 0)
@@ -52,20 +77,20 @@ tabulate_polyset_line_derivs(std::size_t degree, std::size_t nderiv,
     for (std::size_t p = 1; p <= degree; ++p)
     {
       const double a = 1.0 - 1.0 / static_cast<double>(p);
-      xt::col(result, p) = X * xt::col(result, p - 1) * (a + 1.0);
+      xt::noalias(xt::col(result, p)) = X * xt::col(result, p - 1) * (a + 1.0);
       if (k > 0)
-        xt::col(result, p) += 2 * k * xt::col(result0, p - 1) * (a + 1.0);
+        xt::noalias(xt::col(result, p))
+            += 2 * k * xt::col(result0, p - 1) * (a + 1.0);
       if (p > 1)
-        xt::col(result, p) -= xt::col(result, p - 2) * a;
+        xt::noalias(xt::col(result, p)) -= xt::col(result, p - 2) * a;
     }
   }
 
   // Normalise
   for (std::size_t k = 0; k < nderiv + 1; ++k)
-    for (std::size_t p = 0; p <= degree; ++p)
-      xt::view(P, k, xt::all(), p) *= std::sqrt(p + 0.5);
-
-  return P;
+    if (needed(mask, k))
+      for (std::size_t p = 0; p <= degree; ++p)
+        xt::view(P, k, xt::all(), p) *= std::sqrt(p + 0.5);
 }
 //-----------------------------------------------------------------------------
 // Compute the complete set of derivatives from 0 to nderiv, for all the
@@ -75,32 +100,36 @@ tabulate_polyset_line_derivs(std::size_t degree, std::size_t nderiv,
 // above, but with a change of variables. The polynomials are then
 // extended in the q direction, using the relation given in Sherwin and
 // Karniadakis 1995 (https://doi.org/10.1016/0045-7825(94)00745-9).
-xt::xtensor<double, 3>
-tabulate_polyset_triangle_derivs(int n, int nderiv,
-                                 const xt::xtensor<double, 2>& pts)
+template <typename P_t, typename X_t>
+void tabulate_polyset_triangle_derivs(P_t& P, int n, int nderiv,
+                                      const X_t& pts,
+                                      const xtl::span<const int>& mask = {})
 {
   assert(pts.shape(1) == 2);
+  assert(P.shape(0) == (std::size_t)((nderiv + 1) * (nderiv + 2) / 2));
+  assert(P.shape(1) == pts.shape(0));
+  assert(P.shape(2) == (std::size_t)((n + 1) * (n + 2) / 2));
 
   const auto x = pts * 2.0 - 1.0;
   auto x0 = xt::col(x, 0);
   auto x1 = xt::col(x, 1);
 
-  const std::size_t m = (n + 1) * (n + 2) / 2;
-  const std::size_t md = (nderiv + 1) * (nderiv + 2) / 2;
-  xt::xtensor<double, 3> P({md, pts.shape(0), m});
-
   // f3 = ((1 - y) / 2)^2
   const auto f3 = xt::square(1.0 - x1) * 0.25;
 
   // Iterate over derivatives in increasing order, since higher derivatives
 
   // Depend on earlier calculations
-  xt::xtensor<double, 2> result({pts.shape(0), m});
   for (int k = 0; k <= nderiv; ++k)
   {
     for (int kx = 0; kx <= k; ++kx)
     {
       const int ky = k - kx;
+      if (!needed(mask, idx(kx, ky)))
+        continue;
+
+      // Compute this derivative directly in the output
+      auto result = xt::view(P, idx(kx, ky), xt::all(), xt::all());
       if (kx == 0 and ky == 0)
         xt::col(result, 0) = 1.0;
       else
@@ -108,7 +137,7 @@ tabulate_polyset_triangle_derivs(int n, int nderiv,
 
       for (int p = 1; p < n + 1; ++p)
       {
-        auto p0 = xt::col(result, idx(p, 0));
+        auto p0 = xt::noalias(xt::col(result, idx(p, 0)));
         const double a
             = static_cast<double>(2 * p - 1) / static_cast<double>(p);
         p0 = (x0 + 0.5 * x1 + 0.5) * xt::col(result, idx(p - 1, 0)) * a;
@@ -147,7 +176,7 @@ tabulate_polyset_triangle_derivs(int n, int nderiv,
       for (int p = 0; p < n; ++p)
       {
         auto p0 = xt::col(result, idx(p, 0));
-        auto p1 = xt::col(result, idx(p, 1));
+        auto p1 = xt::noalias(xt::col(result, idx(p, 1)));
         p1 = p0 * (x1 * (1.5 + p) + 0.5 + p);
         if (ky > 0)
         {
@@ -158,41 +187,41 @@ tabulate_polyset_triangle_derivs(int n, int nderiv,
         for (int q = 1; q < n - p; ++q)
         {
           const auto [a1, a2, a3] = jrc(2 * p + 1, q);
-          xt::col(result, idx(p, q + 1))
+          xt::noalias(xt::col(result, idx(p, q + 1)))
               = xt::col(result, idx(p, q)) * (x1 * a1 + a2)
                 - xt::col(result, idx(p, q - 1)) * a3;
           if (ky > 0)
           {
             auto result0 = xt::view(P, idx(kx, ky - 1), xt::all(), idx(p, q));
-            xt::col(result, idx(p, q + 1)) += 2 * ky * a1 * result0;
+            xt::noalias(xt::col(result, idx(p, q + 1)))
+                += 2 * ky * a1 * result0;
           }
         }
       }
-
-      // Store
-      xt::view(P, idx(kx, ky), xt::all(), xt::all()) = result;
     }
   }
 
   // Normalisation
   for (std::size_t j = 0; j < P.shape(0); ++j)
   {
+    if (!needed(mask, j))
+      continue;
     auto Pj = xt::view(P, j, xt::all(), xt::all());
     for (int p = 0; p <= n; ++p)
       for (int q = 0; q <= n - p; ++q)
         xt::col(Pj, idx(p, q)) *= std::sqrt((p + 0.5) * (p + q + 1));
   }
-
-  return P;
 }
 //-----------------------------------------------------------------------------
-xt::xtensor<double, 3>
-tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
-                                    const xt::xtensor<double, 2>& pts)
+template <typename P_t, typename X_t>
+void tabulate_polyset_tetrahedron_derivs(P_t& P, int n, std::size_t nderiv,
+                                         const X_t& pts,
+                                         const xtl::span<const int>& mask)
 {
   assert(pts.shape(1) == 3);
-  const std::size_t m = (n + 1) * (n + 2) * (n + 3) / 6;
-  const std::size_t md = (nderiv + 1) * (nderiv + 2) * (nderiv + 3) / 6;
+  assert(P.shape(0) == (nderiv + 1) * (nderiv + 2) * (nderiv + 3) / 6);
+  assert(P.shape(1) == pts.shape(0));
+  assert(P.shape(2) == (std::size_t)((n + 1) * (n + 2) * (n + 3) / 6));
 
   auto x = pts * 2.0 - 1.0;
   const auto x0 = xt::col(x, 0);
@@ -205,8 +234,6 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
   auto f5 = f4 * f4;
 
   // Traverse derivatives in increasing order
-  xt::xtensor<double, 3> P({md, pts.shape(0), m});
-  xt::xtensor<double, 2> result({pts.shape(0), m});
   for (std::size_t k = 0; k <= nderiv; ++k)
   {
     for (std::size_t j = 0; j <= k; ++j)
@@ -215,6 +242,11 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
       {
         const std::size_t ky = j - kx;
         const std::size_t kz = k - j;
+        if (!needed(mask, idx(kx, ky, kz)))
+          continue;
+
+        // Compute this derivative directly in the output
+        auto result = xt::view(P, idx(kx, ky, kz), xt::all(), xt::all());
         if (kx == 0 and ky == 0 and kz == 0)
           xt::col(result, 0) = 1.0;
         else
@@ -222,7 +254,7 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
 
         for (int p = 1; p <= n; ++p)
         {
-          auto p00 = xt::col(result, idx(p, 0, 0));
+          auto p00 = xt::noalias(xt::col(result, idx(p, 0, 0)));
           double a = static_cast<double>(2 * p - 1) / static_cast<double>(p);
           p00 = (x0 + 0.5 * (x1 + x2) + 1.0) * xt::col(result, idx(p - 1, 0, 0))
                 * a;
@@ -294,7 +326,7 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
 
         for (int p = 0; p < n; ++p)
         {
-          auto p10 = xt::col(result, idx(p, 1, 0));
+          auto p10 = xt::noalias(xt::col(result, idx(p, 1, 0)));
           p10 = xt::col(result, idx(p, 0, 0))
                 * ((1.0 + x1) * p + (2.0 + x1 * 3.0 + x2) * 0.5);
           if (ky > 0)
@@ -313,7 +345,7 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
           for (int q = 1; q < n - p; ++q)
           {
             auto [aq, bq, cq] = jrc(2 * p + 1, q);
-            auto pq1 = xt::col(result, idx(p, q + 1, 0));
+            auto pq1 = xt::noalias(xt::col(result, idx(p, q + 1, 0)));
             pq1 = xt::col(result, idx(p, q, 0)) * (f3 * aq + f4 * bq)
                   - xt::col(result, idx(p, q - 1, 0)) * f5 * cq;
 
@@ -351,7 +383,7 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
         {
           for (int q = 0; q < n - p; ++q)
           {
-            auto pq = xt::col(result, idx(p, q, 1));
+            auto pq = xt::noalias(xt::col(result, idx(p, q, 1)));
             pq = xt::col(result, idx(p, q, 0))
                  * ((1.0 + p + q) + x2 * (2.0 + p + q));
             if (kz > 0)
@@ -369,12 +401,12 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
             for (int r = 1; r < n - p - q; ++r)
             {
               auto [ar, br, cr] = jrc(2 * p + 2 * q + 2, r);
-              xt::col(result, idx(p, q, r + 1))
+              xt::noalias(xt::col(result, idx(p, q, r + 1)))
                   = xt::col(result, idx(p, q, r)) * (x2 * ar + br)
                     - xt::col(result, idx(p, q, r - 1)) * cr;
               if (kz > 0)
               {
-                xt::col(result, idx(p, q, r + 1))
+                xt::noalias(xt::col(result, idx(p, q, r + 1)))
                     += 2 * kz * ar
                        * xt::view(P, idx(kx, ky, kz - 1), xt::all(),
                                   idx(p, q, r));
@@ -382,9 +414,6 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
             }
           }
         }
-
-        // Store this derivative
-        xt::view(P, idx(kx, ky, kz), xt::all(), xt::all()) = result;
       }
     }
   }
@@ -392,6 +421,8 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
   // Normalise
   for (std::size_t i = 0; i < P.shape(0); ++i)
   {
+    if (!needed(mask, i))
+      continue;
     auto Pi = xt::view(P, i, xt::all(), xt::all());
     for (int p = 0; p < n + 1; ++p)
     {
@@ -405,17 +436,18 @@ tabulate_polyset_tetrahedron_derivs(int n, std::size_t nderiv,
       }
     }
   }
-
-  return P;
 }
 //-----------------------------------------------------------------------------
-xt::xtensor<double, 3>
-tabulate_polyset_pyramid_derivs(int n, std::size_t nderiv,
-                                const xt::xtensor<double, 2>& pts)
+template <typename P_t, typename X_t>
+void tabulate_polyset_pyramid_derivs(P_t& P, int n, std::size_t nderiv,
+                                     const X_t& pts,
+                                     const xtl::span<const int>& mask)
 {
   assert(pts.shape(1) == 3);
   const std::size_t m = (n + 1) * (n + 2) * (2 * n + 3) / 6;
-  const std::size_t md = (nderiv + 1) * (nderiv + 2) * (nderiv + 3) / 6;
+  assert(P.shape(0) == (nderiv + 1) * (nderiv + 2) * (nderiv + 3) / 6);
+  assert(P.shape(1) == pts.shape(0));
+  assert(P.shape(2) == m);
 
   // Indexing for pyramidal basis functions
   auto pyr_idx = [n](int p, int q, int r) -> std::size_t {
@@ -432,17 +464,20 @@ tabulate_polyset_pyramid_derivs(int n, std::size_t nderiv,
   auto f2 = 0.25 * xt::square(1.0 - x2);
 
   // Traverse derivatives in increasing order
-  xt::xtensor<double, 3> P({md, pts.shape(0), m});
-  xt::xtensor<double, 2> result({pts.shape(0), m});
   for (std::size_t k = 0; k < nderiv + 1; ++k)
   {
     for (std::size_t j = 0; j < k + 1; ++j)
     {
       for (std::size_t kx = 0; kx < j + 1; ++kx)
       {
-        result = xt::zeros<double>(result.shape());
         const std::size_t ky = j - kx;
         const std::size_t kz = k - j;
+        if (!needed(mask, idx(kx, ky, kz)))
+          continue;
+
+        // Compute this derivative directly in the output
+        auto result = xt::view(P, idx(kx, ky, kz), xt::all(), xt::all());
+        result = 0.0;
 
         const std::size_t pyramidal_index = pyr_idx(0, 0, 0);
         assert(pyramidal_index < m);
@@ -458,7 +493,7 @@ tabulate_polyset_pyramid_derivs(int n, std::size_t nderiv,
           {
             const double a
                 = static_cast<double>(p - 1) / static_cast<double>(p);
-            auto p00 = xt::col(result, pyr_idx(p, 0, 0));
+            auto p00 = xt::noalias(xt::col(result, pyr_idx(p, 0, 0)));
             p00 = (0.5 + x0 + x2 * 0.5) * xt::col(result, pyr_idx(p - 1, 0, 0))
                   * (a + 1.0);
 
@@ -505,7 +540,7 @@ tabulate_polyset_pyramid_derivs(int n, std::size_t nderiv,
           {
             const double a
                 = static_cast<double>(q - 1) / static_cast<double>(q);
-            auto r_pq = xt::col(result, pyr_idx(p, q, 0));
+            auto r_pq = xt::noalias(xt::col(result, pyr_idx(p, q, 0)));
             r_pq = (0.5 + x1 + x2 * 0.5) * xt::col(result, pyr_idx(p, q - 1, 0))
                    * (a + 1.0);
             if (ky > 0)
@@ -552,7 +587,7 @@ tabulate_polyset_pyramid_derivs(int n, std::size_t nderiv,
         {
           for (int q = 0; q < n; ++q)
           {
-            auto r_pq1 = xt::col(result, pyr_idx(p, q, 1));
+            auto r_pq1 = xt::noalias(xt::col(result, pyr_idx(p, q, 1)));
             r_pq1 = xt::col(result, pyr_idx(p, q, 0))
                     * ((1.0 + p + q) + x2 * (2.0 + p + q));
             if (kz > 0)
@@ -572,7 +607,7 @@ tabulate_polyset_pyramid_derivs(int n, std::size_t nderiv,
             for (int q = 0; q < n - r; ++q)
             {
               auto [ar, br, cr] = jrc(2 * p + 2 * q + 2, r);
-              auto r_pqr = xt::col(result, pyr_idx(p, q, r + 1));
+              auto r_pqr = xt::noalias(xt::col(result, pyr_idx(p, q, r + 1)));
               r_pqr = xt::col(result, pyr_idx(p, q, r)) * (x2 * ar + br)
                       - xt::col(result, pyr_idx(p, q, r - 1)) * cr;
               if (kz > 0)
@@ -584,14 +619,14 @@ tabulate_polyset_pyramid_derivs(int n, std::size_t nderiv,
             }
           }
         }
-
-        xt::view(P, idx(kx, ky, kz), xt::all(), xt::all()) = result;
       }
     }
   }
 
   for (std::size_t i = 0; i < P.shape(0); ++i)
   {
+    if (!needed(mask, i))
+      continue;
     auto Pi = xt::view(P, i, xt::all(), xt::all());
     for (int r = 0; r < n + 1; ++r)
     {
@@ -605,59 +640,63 @@ tabulate_polyset_pyramid_derivs(int n, std::size_t nderiv,
       }
     }
   }
-
-  return P;
 }
 //-----------------------------------------------------------------------------
-xt::xtensor<double, 3>
-tabulate_polyset_quad_derivs(int n, int nderiv, const xt::xtensor<double, 2>& x)
+template <typename P_t, typename X_t, typename T>
+void tabulate_polyset_quad_derivs(P_t& P, int n, int nderiv, const X_t& x,
+                                  const xtl::span<const int>& mask,
+                                  polyset::workspace<T>& w)
 {
   assert(x.shape(1) == 2);
-  const std::size_t m = (n + 1) * (n + 1);
-  const std::size_t md = (nderiv + 1) * (nderiv + 2) / 2;
+  assert(P.shape(0) == (std::size_t)((nderiv + 1) * (nderiv + 2) / 2));
+  assert(P.shape(1) == x.shape(0));
+  assert(P.shape(2) == (std::size_t)((n + 1) * (n + 1)));
 
   // Compute 1D basis
-  const xt::xtensor<double, 1> x0 = xt::col(x, 0);
-  const xt::xtensor<double, 1> x1 = xt::col(x, 1);
-  xt::xtensor<double, 3> px = tabulate_polyset_line_derivs(n, nderiv, x0);
-  xt::xtensor<double, 3> py = tabulate_polyset_line_derivs(n, nderiv, x1);
+  const std::array<std::size_t, 3> shape1d
+      = {(std::size_t)nderiv + 1, x.shape(0), (std::size_t)n + 1};
+  auto px = factor_table(w.factors[0], shape1d);
+  auto py = factor_table(w.factors[1], shape1d);
+  tabulate_polyset_line_derivs(px, n, nderiv, xt::col(x, 0));
+  tabulate_polyset_line_derivs(py, n, nderiv, xt::col(x, 1));
 
-  xt::xtensor<double, 3> P({md, x.shape(0), m});
   for (int kx = 0; kx < nderiv + 1; ++kx)
   {
     auto p0 = xt::view(px, kx, xt::all(), xt::all());
     for (int ky = 0; ky < nderiv + 1 - kx; ++ky)
     {
+      if (!needed(mask, idx(kx, ky)))
+        continue;
       auto result = xt::view(P, idx(kx, ky), xt::all(), xt::all());
       auto p1 = xt::view(py, ky, xt::all(), xt::all());
       int c = 0;
       for (std::size_t i = 0; i < p0.shape(1); ++i)
         for (std::size_t j = 0; j < p0.shape(1); ++j)
-          xt::col(result, c++) = xt::col(p0, i) * xt::col(p1, j);
+          xt::noalias(xt::col(result, c++)) = xt::col(p0, i) * xt::col(p1, j);
     }
   }
-
-  return P;
 }
 //-----------------------------------------------------------------------------
-xt::xtensor<double, 3>
-tabulate_polyset_hex_derivs(std::size_t n, std::size_t nderiv,
-                            const xt::xtensor<double, 2>& x)
+template <typename P_t, typename X_t, typename T>
+void tabulate_polyset_hex_derivs(P_t& P, std::size_t n, std::size_t nderiv,
+                                 const X_t& x, const xtl::span<const int>& mask,
+                                 polyset::workspace<T>& w)
 {
   assert(x.shape(1) == 3);
-  const std::size_t m = (n + 1) * (n + 1) * (n + 1);
-  const std::size_t md = (nderiv + 1) * (nderiv + 2) * (nderiv + 3) / 6;
+  assert(P.shape(0) == (nderiv + 1) * (nderiv + 2) * (nderiv + 3) / 6);
+  assert(P.shape(1) == x.shape(0));
+  assert(P.shape(2) == (n + 1) * (n + 1) * (n + 1));
 
   // Compute 1D basis
-  const xt::xtensor<double, 1> x0 = xt::col(x, 0);
-  const xt::xtensor<double, 1> x1 = xt::col(x, 1);
-  const xt::xtensor<double, 1> x2 = xt::col(x, 2);
-  xt::xtensor<double, 3> px = tabulate_polyset_line_derivs(n, nderiv, x0);
-  xt::xtensor<double, 3> py = tabulate_polyset_line_derivs(n, nderiv, x1);
-  xt::xtensor<double, 3> pz = tabulate_polyset_line_derivs(n, nderiv, x2);
+  const std::array<std::size_t, 3> shape1d = {nderiv + 1, x.shape(0), n + 1};
+  auto px = factor_table(w.factors[0], shape1d);
+  auto py = factor_table(w.factors[1], shape1d);
+  auto pz = factor_table(w.factors[2], shape1d);
+  tabulate_polyset_line_derivs(px, n, nderiv, xt::col(x, 0));
+  tabulate_polyset_line_derivs(py, n, nderiv, xt::col(x, 1));
+  tabulate_polyset_line_derivs(pz, n, nderiv, xt::col(x, 2));
 
   // Compute basis
-  xt::xtensor<double, 3> P({md, x.shape(0), m});
   for (std::size_t kx = 0; kx < nderiv + 1; ++kx)
   {
     auto p0 = xt::view(px, kx, xt::all(), xt::all());
@@ -666,6 +705,8 @@ tabulate_polyset_hex_derivs(std::size_t n, std::size_t nderiv,
       auto p1 = xt::view(py, ky, xt::all(), xt::all());
       for (std::size_t kz = 0; kz < nderiv + 1 - kx - ky; ++kz)
       {
+        if (!needed(mask, idx(kx, ky, kz)))
+          continue;
         auto result = xt::view(P, idx(kx, ky, kz), xt::all(), xt::all());
         auto p2 = xt::view(pz, kz, xt::all(), xt::all());
         int c = 0;
@@ -676,30 +717,35 @@ tabulate_polyset_hex_derivs(std::size_t n, std::size_t nderiv,
           {
             auto pj = xt::col(p1, j);
             for (std::size_t k = 0; k < p2.shape(1); ++k)
-              xt::col(result, c++) = pi * pj * xt::col(p2, k);
+              xt::noalias(xt::col(result, c++)) = pi * pj * xt::col(p2, k);
           }
         }
       }
     }
   }
-
-  return P;
 }
 //-----------------------------------------------------------------------------
-xt::xtensor<double, 3>
-tabulate_polyset_prism_derivs(std::size_t n, std::size_t nderiv,
-                              const xt::xtensor<double, 2>& x)
+template <typename P_t, typename X_t, typename T>
+void tabulate_polyset_prism_derivs(P_t& P, std::size_t n, std::size_t nderiv,
+                                   const X_t& x,
+                                   const xtl::span<const int>& mask,
+                                   polyset::workspace<T>& w)
 {
   assert(x.shape(1) == 3);
-  const std::size_t m = (n + 1) * (n + 1) * (n + 2) / 2;
-  const std::size_t md = (nderiv + 1) * (nderiv + 2) * (nderiv + 3) / 6;
+  assert(P.shape(0) == (nderiv + 1) * (nderiv + 2) * (nderiv + 3) / 6);
+  assert(P.shape(1) == x.shape(0));
+  assert(P.shape(2) == (n + 1) * (n + 1) * (n + 2) / 2);
+
+  // Compute triangle and 1D bases
+  const std::array<std::size_t, 3> shape2d
+      = {(nderiv + 1) * (nderiv + 2) / 2, x.shape(0), (n + 1) * (n + 2) / 2};
+  const std::array<std::size_t, 3> shape1d = {nderiv + 1, x.shape(0), n + 1};
+  auto pxy = factor_table(w.factors[0], shape2d);
+  auto pz = factor_table(w.factors[1], shape1d);
+  tabulate_polyset_triangle_derivs(pxy, n, nderiv,
+                                   xt::view(x, xt::all(), xt::range(0, 2)));
+  tabulate_polyset_line_derivs(pz, n, nderiv, xt::col(x, 2));
 
-  const xt::xtensor<double, 2> x01 = xt::view(x, xt::all(), xt::range(0, 2));
-  const xt::xtensor<double, 1> x2 = xt::col(x, 2);
-  xt::xtensor<double, 3> pxy = tabulate_polyset_triangle_derivs(n, nderiv, x01);
-  xt::xtensor<double, 3> pz = tabulate_polyset_line_derivs(n, nderiv, x2);
-
-  xt::xtensor<double, 3> P({md, x.shape(0), m});
   for (std::size_t kx = 0; kx < nderiv + 1; ++kx)
   {
     for (std::size_t ky = 0; ky < nderiv + 1 - kx; ++ky)
@@ -707,45 +753,95 @@ tabulate_polyset_prism_derivs(std::size_t n, std::size_t nderiv,
       auto p0 = xt::view(pxy, idx(kx, ky), xt::all(), xt::all());
       for (std::size_t kz = 0; kz < nderiv + 1 - kx - ky; ++kz)
       {
+        if (!needed(mask, idx(kx, ky, kz)))
+          continue;
         auto p1 = xt::view(pz, kz, xt::all(), xt::all());
         auto result = xt::view(P, idx(kx, ky, kz), xt::all(), xt::all());
         int c = 0;
         for (std::size_t i = 0; i < p0.shape(1); ++i)
           for (std::size_t k = 0; k < p1.shape(1); ++k)
-            xt::col(result, c++) = xt::col(p0, i) * xt::col(p1, k);
+            xt::noalias(xt::col(result, c++)) = xt::col(p0, i) * xt::col(p1, k);
       }
     }
   }
-
-  return P;
 }
 } // namespace
 //-----------------------------------------------------------------------------
 xt::xtensor<double, 3> polyset::tabulate(cell::type celltype, int d, int n,
                                          const xt::xarray<double>& x)
 {
+  const std::size_t tdim = cell::topological_dimension(celltype);
+  if (tdim == 0)
+    throw std::runtime_error("Polynomial set: unsupported cell type");
+  const std::size_t num_points = x.size() / tdim;
+  xt::xtensor<double, 3> P(
+      {(std::size_t)polyset::nderivs(celltype, n), num_points,
+       (std::size_t)polyset::dim(celltype, d)});
+  polyset::workspace<double> w;
+  polyset::tabulate(xtl::span<double>(P.data(), P.size()), celltype, d, n,
+                    xtl::span<const double>(x.data(), x.size()), w);
+  return P;
+}
+//-----------------------------------------------------------------------------
+template <typename T>
+void polyset::tabulate(const xtl::span<T>& P, cell::type celltype, int d,
+                       int n, const xtl::span<const T>& x,
+                       polyset::workspace<T>& w,
+                       const xtl::span<const int>& mask)
+{
+  const std::size_t tdim = cell::topological_dimension(celltype);
+  if (tdim == 0)
+    throw std::runtime_error("Polynomial set: unsupported cell type");
+
+  const std::size_t num_points = x.size() / tdim;
+  const std::array<std::size_t, 3> shape
+      = {(std::size_t)polyset::nderivs(celltype, n), num_points,
+         (std::size_t)polyset::dim(celltype, d)};
+  if (P.size() != shape[0] * shape[1] * shape[2])
+    throw std::runtime_error("Polynomial set: output has the wrong size");
+  if (!mask.empty() and mask.size() != shape[0])
+    throw std::runtime_error("Polynomial set: mask has the wrong size");
+
+  auto _P = xt::adapt(P.data(), P.size(), xt::no_ownership(), shape);
+  if (celltype == cell::type::interval)
+  {
+    std::array<std::size_t, 1> xshape = {num_points};
+    auto _x = xt::adapt(x.data(), x.size(), xt::no_ownership(), xshape);
+    tabulate_polyset_line_derivs(_P, d, n, _x, mask);
+    return;
+  }
+
+  std::array<std::size_t, 2> xshape = {num_points, tdim};
+  auto _x = xt::adapt(x.data(), x.size(), xt::no_ownership(), xshape);
   switch (celltype)
   {
-  case cell::type::interval:
-    assert(x.dimension() == 1);
-    return tabulate_polyset_line_derivs(d, n, x);
   case cell::type::triangle:
-    return tabulate_polyset_triangle_derivs(d, n, x);
+    return tabulate_polyset_triangle_derivs(_P, d, n, _x, mask);
   case cell::type::tetrahedron:
-    return tabulate_polyset_tetrahedron_derivs(d, n, x);
+    return tabulate_polyset_tetrahedron_derivs(_P, d, n, _x, mask);
   case cell::type::quadrilateral:
-    return tabulate_polyset_quad_derivs(d, n, x);
+    return tabulate_polyset_quad_derivs(_P, d, n, _x, mask, w);
   case cell::type::prism:
-    return tabulate_polyset_prism_derivs(d, n, x);
+    return tabulate_polyset_prism_derivs(_P, d, n, _x, mask, w);
   case cell::type::pyramid:
-    return tabulate_polyset_pyramid_derivs(d, n, x);
+    return tabulate_polyset_pyramid_derivs(_P, d, n, _x, mask);
   case cell::type::hexahedron:
-    return tabulate_polyset_hex_derivs(d, n, x);
+    return tabulate_polyset_hex_derivs(_P, d, n, _x, mask, w);
   default:
     throw std::runtime_error("Polynomial set: unsupported cell type");
   }
 }
 //-----------------------------------------------------------------------------
+// Explicit instantiation for double and float
+template void polyset::tabulate(const xtl::span<double>&, cell::type, int, int,
+                                const xtl::span<const double>&,
+                                polyset::workspace<double>&,
+                                const xtl::span<const int>&);
+template void polyset::tabulate(const xtl::span<float>&, cell::type, int, int,
+                                const xtl::span<const float>&,
+                                polyset::workspace<float>&,
+                                const xtl::span<const int>&);
+//-----------------------------------------------------------------------------
 int polyset::dim(cell::type celltype, int d)
 {
   switch (celltype)
@@ -769,3 +865,18 @@ int polyset::dim(cell::type celltype, int d)
   }
 }
 //-----------------------------------------------------------------------------
+int polyset::nderivs(cell::type celltype, int n)
+{
+  switch (cell::topological_dimension(celltype))
+  {
+  case 1:
+    return n + 1;
+  case 2:
+    return (n + 1) * (n + 2) / 2;
+  case 3:
+    return (n + 1) * (n + 2) * (n + 3) / 6;
+  default:
+    return 1;
+  }
+}
+//-----------------------------------------------------------------------------
@@ -5,8 +5,11 @@
 #pragma once
 
 #include "cell.h"
+#include <array>
+#include <vector>
 #include <xtensor/xarray.hpp>
 #include <xtensor/xtensor.hpp>
+#include <xtl/xspan.hpp>
 
 /// ## Orthonormal polynomial basis on reference cell
 /// These are the underlying "expansion sets" for all finite elements,
@@ -57,6 +60,50 @@ namespace basix::polyset
 xt::xtensor<double, 3> tabulate(cell::type celltype, int d, int n,
                                 const xt::xarray<double>& x);
 
+/// Scratch memory used by the in-place version of polyset::tabulate.
+/// The buffers grow as required and keep their capacity when fewer
+/// points are tabulated, so re-using a workspace for repeated calls
+/// with the same cell and degree and at most the same number of
+/// points avoids all memory allocation.
+template <typename T>
+struct workspace
+{
+  /// Tables of the lower-dimensional factors of the polyset on
+  /// tensor-product cells, stored row-major
+  std::array<std::vector<T>, 3> factors;
+};
+
+/// Tabulate the orthonormal polynomial basis, and derivatives, at
+/// points on the reference cell, writing the result into
+/// caller-provided memory. The data layout is the same as for the
+/// allocating version of polyset::tabulate.
+///
+/// This function is instantiated for `T = double` and `T = float`. In
+/// single precision the recurrence coefficients are applied in double
+/// precision and the results rounded when stored.
+///
+/// @param[out] P Memory for the tabulated polynomial sets, with
+/// row-major shape `(polyset::nderivs(celltype, n), number of points,
+/// polyset::dim(celltype, d))`
+/// @param[in] celltype Cell type
+/// @param[in] d Polynomial degree
+/// @param[in] n Maximum derivative order. Use n = 0 for the basis only.
+/// @param[in] x Points at which to evaluate the basis, stored
+/// contiguously and row-major with shape (number of points,
+/// topological dimension)
+/// @param[in,out] w Workspace
+/// @param[in] mask If not empty, one entry for each derivative, which
+/// is nonzero if that derivative is needed. Only the needed
+/// derivatives are written to @p P. The set of needed derivatives
+/// must be closed downwards, i.e. if @f$(p, q, r)@f$ is needed then so
+/// is every @f$(p', q', r')@f$ with @f$p' \leq p@f$, @f$q' \leq q@f$ and
+/// @f$r' \leq r@f$, as the recurrences for each derivative use the
+/// lower derivatives.
+template <typename T>
+void tabulate(const xtl::span<T>& P, cell::type celltype, int d, int n,
+              const xtl::span<const T>& x, workspace<T>& w,
+              const xtl::span<const int>& mask = {});
+
 /// Dimension of a polynomial space
 /// @param[in] cell The cell type
 /// @param[in] d The polynomial degree
@@ -64,4 +111,10 @@ xt::xtensor<double, 3> tabulate(cell::type celltype, int d, int n,
 /// polynomial degree @p d
 int dim(cell::type cell, int d);
 
+/// Number of derivatives computed by polyset::tabulate
+/// @param[in] cell The cell type
+/// @param[in] n The maximum derivative order
+/// @return The number of derivatives of order up to and including @p n
+int nderivs(cell::type cell, int n);
+
 } // namespace basix::polyset
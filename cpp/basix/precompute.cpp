@@ -3,7 +3,8 @@
 // SPDX-License-Identifier:    MIT
 
 #include "precompute.h"
-#include <xtensor-blas/xlinalg.hpp>
+#include <cmath>
+#include <numeric>
 
 using namespace basix;
 
@@ -28,67 +29,74 @@ precompute::prepare_matrix(const xt::xtensor<double, 2>& matrix)
 {
   using T = double;
   const std::size_t dim = matrix.shape(0);
-  std::vector<std::size_t> perm(dim);
-  xt::xtensor<T, 2> permuted_matrix({dim, dim});
-  std::vector<T> diag(dim);
 
-  // Permute the matrix so that all the top left blocks are invertible
+  // LU factorisation A = LU of the matrix with its columns permuted,
+  // with L unit lower triangular. The columns are chosen so that all
+  // the top left blocks are invertible: the determinant of the top
+  // left (i + 1) x (i + 1) block of the permuted matrix is the
+  // determinant of the top left i x i block multiplied by U(i, i), so
+  // the column that maximises |U(i, i)| is the column that maximises
+  // the determinant. L (below the diagonal) and U are stored in LU.
+  xt::xtensor<T, 2> LU = matrix;
+  std::vector<std::size_t> perm(dim);
+  std::iota(perm.begin(), perm.end(), 0);
   for (std::size_t i = 0; i < dim; ++i)
   {
-    double max_det = 0;
-    std::size_t col = 0;
-    for (std::size_t j = 0; j < dim; ++j)
+    // Choose the remaining column of the original matrix with the
+    // lowest index among those that give the largest pivot
+    std::size_t col = i;
+    double max_pivot = 0;
+    for (std::size_t j = i; j < dim; ++j)
     {
-      const bool used = std::find(perm.begin(), std::next(perm.begin(), i), j)
-                        != std::next(perm.begin(), i);
-      if (!used)
+      const double pivot = std::abs(LU(i, j));
+      if (pivot > max_pivot or (pivot == max_pivot and perm[j] < perm[col]))
       {
-        xt::col(permuted_matrix, i) = xt::col(matrix, j);
-        double det = std::abs(xt::linalg::det(xt::view(
-            permuted_matrix, xt::range(0, i + 1), xt::range(0, i + 1))));
-        if (det > max_det)
-        {
-          max_det = det;
-          col = j;
-        }
+        max_pivot = pivot;
+        col = j;
       }
     }
 
-    xt::col(permuted_matrix, i) = xt::col(matrix, col);
-    perm[i] = col;
-  }
-
-  // Create the precomputed representation of the matrix
-  xt::xtensor<T, 2> prepared_matrix({dim, dim});
-
-  for (std::size_t i = 0; i < dim; ++i)
-  {
-    diag[i] = permuted_matrix(i, i);
-    prepared_matrix(i, i) = 0;
-    if (i < dim - 1)
+    if (col != i)
     {
-      xt::view(prepared_matrix, i, xt::range(i + 1, dim))
-          = xt::view(permuted_matrix, i, xt::range(i + 1, dim));
+      for (std::size_t r = 0; r < dim; ++r)
+        std::swap(LU(r, i), LU(r, col));
+      std::swap(perm[i], perm[col]);
     }
 
-    if (i > 0)
+    if (LU(i, i) != 0)
     {
-      xt::xtensor<T, 1> v = xt::linalg::solve(
-          xt::transpose(
-              xt::view(permuted_matrix, xt::range(0, i), xt::range(0, i))),
-          xt::view(permuted_matrix, i, xt::range(0, i)));
-
-      xt::view(prepared_matrix, i, xt::range(0, i)) = v;
-      diag[i] -= xt::linalg::dot(
-          v, xt::view(permuted_matrix, xt::range(0, i), i))(0);
-      for (std::size_t j = i + 1; j < dim; ++j)
+      for (std::size_t r = i + 1; r < dim; ++r)
       {
-        prepared_matrix(i, j) -= xt::linalg::dot(
-            v, xt::view(permuted_matrix, xt::range(0, i), j))(0);
+        const T l = LU(r, i) / LU(i, i);
+        LU(r, i) = l;
+        for (std::size_t j = i + 1; j < dim; ++j)
+          LU(r, j) -= l * LU(i, j);
       }
     }
   }
 
+  // Create the precomputed representation of the matrix. The diagonal
+  // and the part above it are U, and the part below the diagonal is I
+  // - L^{-1}, as A_{i,:i}A_{:i,:i}^{-1} = (I - L^{-1})_{i,:i}
+  xt::xtensor<T, 2> prepared_matrix = xt::zeros<T>({dim, dim});
+  std::vector<T> diag(dim);
+  for (std::size_t i = 0; i < dim; ++i)
+  {
+    diag[i] = LU(i, i);
+    for (std::size_t j = i + 1; j < dim; ++j)
+      prepared_matrix(i, j) = LU(i, j);
+
+    // Row i of L^{-1} by forward substitution, using the rows above,
+    // which hold -L^{-1}
+    for (std::size_t j = 0; j < i; ++j)
+    {
+      T v = LU(i, j);
+      for (std::size_t k = j + 1; k < i; ++k)
+        v -= LU(i, k) * prepared_matrix(k, j);
+      prepared_matrix(i, j) = v;
+    }
+  }
+
   return {prepare_permutation(perm), std::move(diag),
           std::move(prepared_matrix)};
 }
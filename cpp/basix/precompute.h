@@ -4,17 +4,175 @@
 
 #pragma once
 
+#include <type_traits>
 #include <vector>
 #include <xtensor/xtensor.hpp>
 #include <xtensor/xview.hpp>
 #include <xtl/xspan.hpp>
 
+#ifdef XTENSOR_USE_XSIMD
+#include <xsimd/xsimd.hpp>
+#endif
+
 /// ## Matrix and permutation precomputation
 /// These functions generate precomputed version of matrices to allow
 /// application without temporary memory assignment later
 namespace basix::precompute
 {
 
+namespace impl
+{
+// Return true if arrays of type E can be processed with SIMD batches
+template <typename E>
+constexpr bool use_simd()
+{
+#ifdef XTENSOR_USE_XSIMD
+  if constexpr (std::is_same_v<E, float> or std::is_same_v<E, double>)
+    return xsimd::simd_traits<E>::size > 1;
+  else
+    return false;
+#else
+  return false;
+#endif
+}
+
+// y *= a for arrays of length n
+template <typename T, typename E>
+void scal(std::size_t n, T a, E* y)
+{
+  std::size_t k = 0;
+#ifdef XTENSOR_USE_XSIMD
+  if constexpr (use_simd<E>())
+  {
+    using batch = xsimd::simd_type<E>;
+    constexpr std::size_t w = xsimd::simd_traits<E>::size;
+    const batch av(static_cast<E>(a));
+    for (; k + w <= n; k += w)
+      xsimd::store_unaligned(y + k, av * xsimd::load_unaligned(y + k));
+  }
+#endif
+  for (; k < n; ++k)
+    y[k] *= a;
+}
+
+// y += a * x for arrays of length n
+template <typename T, typename E>
+void axpy(std::size_t n, T a, const E* x, E* y)
+{
+  std::size_t k = 0;
+#ifdef XTENSOR_USE_XSIMD
+  if constexpr (use_simd<E>())
+  {
+    using batch = xsimd::simd_type<E>;
+    constexpr std::size_t w = xsimd::simd_traits<E>::size;
+    const batch av(static_cast<E>(a));
+    for (; k + w <= n; k += w)
+    {
+      xsimd::store_unaligned(y + k, xsimd::fma(av, xsimd::load_unaligned(x + k),
+                                               xsimd::load_unaligned(y + k)));
+    }
+  }
+#endif
+  for (; k < n; ++k)
+    y[k] += a * x[k];
+}
+
+// Return the sum of a[k] * x[k] for arrays of length n
+template <typename T, typename E>
+E dot(std::size_t n, const T* a, const E* x)
+{
+  std::size_t k = 0;
+  E s = 0;
+#ifdef XTENSOR_USE_XSIMD
+  if constexpr (std::is_same_v<T, E> and use_simd<E>())
+  {
+    using batch = xsimd::simd_type<E>;
+    constexpr std::size_t w = xsimd::simd_traits<E>::size;
+    if (n >= w)
+    {
+      batch sv(E(0));
+      for (; k + w <= n; k += w)
+      {
+        sv = xsimd::fma(xsimd::load_unaligned(a + k),
+                        xsimd::load_unaligned(x + k), sv);
+      }
+      s = xsimd::hadd(sv);
+    }
+  }
+#endif
+  for (; k < n; ++k)
+    s += a[k] * x[k];
+  return s;
+}
+
+// Call f with std::integral_constant<std::size_t, dim> if 0 < dim <=
+// N, and with std::integral_constant<std::size_t, 0> otherwise
+template <std::size_t N, typename F>
+void dispatch_dim(std::size_t dim, F&& f)
+{
+  if constexpr (N == 0)
+    f(std::integral_constant<std::size_t, 0>());
+  else if (dim == N)
+    f(std::integral_constant<std::size_t, N>());
+  else
+    dispatch_dim<N - 1>(dim, f);
+}
+
+// Apply the diagonal and matrix of a precomputed matrix with dim rows
+// to data in which the block_size values of each DOF are contiguous.
+// All the blocks of a DOF are updated together, so that the innermost
+// loop is over contiguous data. If N is not zero, it is the number of
+// rows, known at compile time.
+template <std::size_t N, typename T, typename E>
+void apply_prepared(std::size_t dim, const T* diag, const T* M, E* data,
+                    std::size_t block_size)
+{
+  const std::size_t n = N == 0 ? dim : N;
+  if (block_size == 1)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      data[i] *= diag[i];
+      for (std::size_t j = 0; j < n; ++j)
+        data[i] += M[i * n + j] * data[j];
+    }
+  }
+  else
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      E* row = data + i * block_size;
+      scal(block_size, diag[i], row);
+      for (std::size_t j = 0; j < n; ++j)
+      {
+        // The diagonal of M is zero
+        if (j != i)
+          axpy(block_size, M[i * n + j], data + j * block_size, row);
+      }
+    }
+  }
+}
+
+// Apply the diagonal and matrix of a precomputed matrix with dim rows
+// to transposed data, in which each of the block_size rows has
+// data_size values and starts at data. Each row of the data is
+// contiguous, so each entry is updated with a dot product. If N is not
+// zero, it is the number of rows, known at compile time.
+template <std::size_t N, typename T, typename E>
+void apply_prepared_to_transpose(std::size_t dim, const T* diag, const T* M,
+                                 E* data, std::size_t data_size,
+                                 std::size_t block_size)
+{
+  const std::size_t n = N == 0 ? dim : N;
+  for (std::size_t b = 0; b < block_size; ++b)
+  {
+    E* x = data + data_size * b;
+    for (std::size_t i = 0; i < n; ++i)
+      x[i] = diag[i] * x[i] + dot(n, M + i * n, x);
+  }
+}
+} // namespace impl
+
 /// Prepare a permutation
 ///
 /// This computes a representation of the permutation that allows the
@@ -115,7 +273,7 @@ prepare_permutation(const std::vector<std::size_t>& perm);
 /// @param[in] offset The position in the data to start applying the permutation
 /// @param[in] block_size The block size of the data
 template <typename E>
-void apply_permutation(const std::vector<std::size_t>& perm,
+void apply_permutation(const xtl::span<const std::size_t>& perm,
                        const xtl::span<E>& data, std::size_t offset = 0,
                        std::size_t block_size = 1)
 {
@@ -133,7 +291,7 @@ void apply_permutation(const std::vector<std::size_t>& perm,
 ///
 /// see `apply_permutation()`.
 template <typename E>
-void apply_permutation_to_transpose(const std::vector<std::size_t>& perm,
+void apply_permutation_to_transpose(const xtl::span<const std::size_t>& perm,
                                     const xtl::span<E>& data,
                                     std::size_t offset = 0,
                                     std::size_t block_size = 1)
@@ -179,6 +337,10 @@ void apply_permutation_to_transpose(const std::vector<std::size_t>& perm,
 /// `prepare_permutation()`), the vector @f$D@f$, and the matrix @f$M@f$ as a
 /// tuple.
 ///
+/// The permutation and the representation are computed from an LU
+/// factorisation of the matrix with column pivoting, at a cost of
+/// @f$O(n^3)@f$ for an @f$n\times n@f$ matrix.
+///
 /// Example
 /// -------
 /// As an example, consider the matrix @f$A = @f$ `[[-1, 0, 1], [1, 1, 0], [2,
@@ -267,6 +429,11 @@ prepare_matrix(const xt::xtensor<double, 2>& matrix);
 /// The `offset` is set, this will start applying the permutation at the
 /// `offset`th block.
 ///
+/// The values of all the blocks of each DOF are updated together, so
+/// the innermost loop runs over contiguous data (using SIMD if xtensor
+/// is built with xsimd). Kernels with a compile-time size are used for
+/// matrices with up to 10 rows.
+///
 /// Example
 /// -------
 /// As an example, consider the matrix @f$A = @f$ `[[-1, 0, 1], [1, 1, 0], [2,
@@ -302,40 +469,78 @@ prepare_matrix(const xt::xtensor<double, 2>& matrix);
 /// add @f$-2\times-1 + 0\times2 + 0\times8 = 2@f$. After this, @f$v@f$ is `[-1,
 /// 2, 10]`. This final value of @f$v@f$ is what the result of @f$Av@f$
 ///
-/// @param[in] matrix A matrix in precomputed form (as returned by
+/// @param[in] perm The permutation of the matrix in precomputed form
+/// (the first item returned by `prepare_matrix()`)
+/// @param[in] diag The vector @f$D@f$ (the second item returned by
 /// `prepare_matrix()`)
+/// @param[in] M The matrix @f$M@f$ (the third item returned by
+/// `prepare_matrix()`), in row-major order
 /// @param[in,out] data The data to apply the permutation to
 /// @param[in] offset The position in the data to start applying the permutation
 /// @param[in] block_size The block size of the data
 template <typename T, typename E>
+void apply_matrix(const xtl::span<const std::size_t>& perm,
+                  const xtl::span<const T>& diag, const xtl::span<const T>& M,
+                  const xtl::span<E>& data, std::size_t offset = 0,
+                  std::size_t block_size = 1)
+{
+  const std::size_t dim = perm.size();
+  apply_permutation(perm, data, offset, block_size);
+  E* x = data.data() + block_size * offset;
+  impl::dispatch_dim<10>(
+      dim,
+      [&](auto n)
+      {
+        impl::apply_prepared<decltype(n)::value>(dim, diag.data(), M.data(),
+                                                 x, block_size);
+      });
+}
+
+/// Apply a (precomputed) matrix
+///
+/// See `apply_matrix()`. This version takes the representation
+/// returned by `prepare_matrix()` as a tuple.
+template <typename T, typename E>
 void apply_matrix(const std::tuple<std::vector<std::size_t>, std::vector<T>,
                                    xt::xtensor<T, 2>>& matrix,
                   const xtl::span<E>& data, std::size_t offset = 0,
                   std::size_t block_size = 1)
 {
-  const std::vector<std::size_t>& v_size_t = std::get<0>(matrix);
-  const std::vector<T>& v_t = std::get<1>(matrix);
   const xt::xtensor<T, 2>& M = std::get<2>(matrix);
+  apply_matrix(xtl::span<const std::size_t>(std::get<0>(matrix)),
+               xtl::span<const T>(std::get<1>(matrix)),
+               xtl::span<const T>(M.data(), M.size()), data, offset,
+               block_size);
+}
 
-  const std::size_t dim = v_size_t.size();
-  apply_permutation(v_size_t, data, offset, block_size);
-  for (std::size_t b = 0; b < block_size; ++b)
-  {
-    for (std::size_t i = 0; i < dim; ++i)
-    {
-      data[block_size * (offset + i) + b] *= v_t[i];
-      for (std::size_t j = 0; j < dim; ++j)
+/// Apply a (precomputed) matrix to some transposed data.
+///
+/// See `apply_matrix()`.
+template <typename T, typename E>
+void apply_matrix_to_transpose(const xtl::span<const std::size_t>& perm,
+                               const xtl::span<const T>& diag,
+                               const xtl::span<const T>& M,
+                               const xtl::span<E>& data,
+                               std::size_t offset = 0,
+                               std::size_t block_size = 1)
+{
+  const std::size_t dim = perm.size();
+  const std::size_t data_size = data.size() / block_size;
+  apply_permutation_to_transpose(perm, data, offset, block_size);
+  E* x = data.data() + offset;
+  impl::dispatch_dim<10>(
+      dim,
+      [&](auto n)
       {
-        data[block_size * (offset + i) + b]
-            += M(i, j) * data[block_size * (offset + j) + b];
-      }
-    }
-  }
+        impl::apply_prepared_to_transpose<decltype(n)::value>(
+            dim, diag.data(), M.data(), x, data_size, block_size);
+      });
 }
 
 /// Apply a (precomputed) matrix to some transposed data.
 ///
-/// See `apply_matrix()`.
+/// See `apply_matrix()`. This version takes the representation
+/// returned by `prepare_matrix()` as a tuple.
 template <typename T, typename E>
 void apply_matrix_to_transpose(
     const std::tuple<std::vector<std::size_t>, std::vector<T>,
@@ -343,25 +548,11 @@ void apply_matrix_to_transpose(
     const xtl::span<E>& data, std::size_t offset = 0,
     std::size_t block_size = 1)
 {
-  const std::vector<std::size_t>& v_size_t = std::get<0>(matrix);
-  const std::vector<T>& v_t = std::get<1>(matrix);
   const xt::xtensor<T, 2>& M = std::get<2>(matrix);
-
-  const std::size_t dim = v_size_t.size();
-  const std::size_t data_size = data.size() / block_size;
-  apply_permutation_to_transpose(v_size_t, data, offset, block_size);
-  for (std::size_t b = 0; b < block_size; ++b)
-  {
-    for (std::size_t i = 0; i < dim; ++i)
-    {
-      data[data_size * b + offset + i] *= v_t[i];
-      for (std::size_t j = 0; j < dim; ++j)
-      {
-        data[data_size * b + offset + i]
-            += M(i, j) * data[data_size * b + offset + j];
-      }
-    }
-  }
+  apply_matrix_to_transpose(xtl::span<const std::size_t>(std::get<0>(matrix)),
+                            xtl::span<const T>(std::get<1>(matrix)),
+                            xtl::span<const T>(M.data(), M.size()), data,
+                            offset, block_size);
 }
 
 } // namespace basix::precompute
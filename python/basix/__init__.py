@@ -7,7 +7,9 @@ functionality can be used via this Python interface.
 
 # Public interface
 from ._basixcpp import __version__
-from ._basixcpp import create_element, CellType, cell_to_str, mapping_to_str, family_to_str, MappingType
+from ._basixcpp import (create_element, CellType, cell_to_str, mapping_to_str, family_to_str, MappingType,
+                        LayoutType, DofTransformationType, create_element_cached, element_cache_statistics,
+                        clear_element_cache, set_element_cache_directory)
 from . import cell
 
 # To possibly be removed
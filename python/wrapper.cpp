@@ -10,6 +10,8 @@
 #include <basix/maps.h>
 #include <basix/polyset.h>
 #include <basix/quadrature.h>
+#include <algorithm>
+#include <memory>
 #include <pybind11/numpy.h>
 #include <pybind11/operators.h>
 #include <pybind11/pybind11.h>
@@ -34,6 +36,12 @@ nderiv : int
 points : numpy.ndarray
     Array of points
 
+num_threads : int
+    Number of threads to use. The result does not depend on the number of threads.
+
+layout : basix.LayoutType
+    Ordering of the indices of the table (`tabulate_x` only)
+
 Returns
 =======
 List[numpy.ndarray]
@@ -90,6 +98,48 @@ auto adapt_x(const py::array_t<double, py::array::c_style>& x)
     shape.push_back(x.shape(i));
   return xt::adapt(x.data(), x.size(), xt::no_ownership(), shape);
 }
+
+// Tabulate an element directly from the memory of a numpy array of
+// points, with shape (num points, tdim) or (num points,), into a new
+// numpy array with the given shape, which must have the same size as
+// FiniteElement::tabulate_shape
+template <typename T>
+py::array_t<T> tabulate_element(const FiniteElement& element, int n,
+                                const py::array_t<T, py::array::c_style>& x,
+                                int num_threads, layout::type layout,
+                                const std::vector<std::size_t>& shape)
+{
+  const std::array<std::size_t, 2> xshape
+      = {(std::size_t)x.shape(0),
+         x.ndim() == 1 ? 1 : (std::size_t)x.shape(1)};
+  py::array_t<T> t(shape);
+  element.tabulate(n, xtl::span<const T>(x.data(), x.size()), xshape,
+                   xtl::span<T>(t.mutable_data(), t.size()), num_threads,
+                   layout);
+  return t;
+}
+
+// Tabulate an element at points, with shape (num points, dim) or (num
+// points,), on the reference sub-entity mapped onto each sub-entity of
+// dimension dim
+py::array_t<double>
+tabulate_sub_entities(const FiniteElement& element, int n, int dim,
+                      const py::array_t<double, py::array::c_style>& x)
+{
+  const std::array<std::size_t, 2> xshape
+      = {(std::size_t)x.shape(0),
+         x.ndim() == 1 ? 1 : (std::size_t)x.shape(1)};
+  std::vector<std::size_t> shape
+      = element.tabulate_shape(n, xshape[0], layout::type::pointDofValue);
+  shape.insert(shape.begin(),
+               cell::num_sub_entities(element.cell_type(), dim));
+  py::array_t<double> t(shape);
+  TabulateWorkspace<double> w;
+  element.tabulate_sub_entities(
+      n, dim, xtl::span<const double>(x.data(), x.size()), xshape,
+      xtl::span<double>(t.mutable_data(), t.size()), w);
+  return t;
+}
 } // namespace
 
 PYBIND11_MODULE(_basixcpp, m)
@@ -144,6 +194,19 @@ Interface to the Basix C++ library.
       },
       "Create a uniform lattice of points on a reference cell");
 
+  py::enum_<layout::type>(m, "LayoutType")
+      .value("pointDofValue", layout::type::pointDofValue)
+      .value("pointValueDof", layout::type::pointValueDof)
+      .value("valuePointDof", layout::type::valuePointDof)
+      .value("valueDofPoint", layout::type::valueDofPoint)
+      .value("interleaved", layout::type::interleaved);
+
+  py::enum_<doftransform::type>(m, "DofTransformationType")
+      .value("standard", doftransform::type::standard)
+      .value("transpose", doftransform::type::transpose)
+      .value("inverse", doftransform::type::inverse)
+      .value("inverse_transpose", doftransform::type::inverse_transpose);
+
   py::enum_<maps::type>(m, "MappingType")
       .value("identity", maps::type::identity)
       .value("covariantPiola", maps::type::covariantPiola)
@@ -278,29 +341,227 @@ Interface to the Basix C++ library.
   //     },
   //     "Create an element from basic data");
 
-  py::class_<FiniteElement>(m, "FiniteElement", "Finite Element")
+  py::class_<TabulateWorkspace<double>>(
+      m, "TabulateWorkspace",
+      "Scratch memory that can be reused by calls to "
+      "FiniteElement.tabulate_into")
+      .def(py::init<>());
+
+  py::class_<FiniteElement, std::shared_ptr<FiniteElement>>(
+      m, "FiniteElement", "Finite Element")
+      .def(py::pickle(
+          [](const FiniteElement& self)
+          {
+            const std::vector<char> data = self.serialize();
+            return py::bytes(data.data(), data.size());
+          },
+          [](const py::bytes& data)
+          {
+            char* buffer;
+            py::ssize_t size;
+            if (PyBytes_AsStringAndSize(data.ptr(), &buffer, &size) != 0)
+              throw py::error_already_set();
+            return basix::deserialize_element(
+                xtl::span<const char>(buffer, size));
+          }))
       .def(
           "tabulate",
           [](const FiniteElement& self, int n,
-             const py::array_t<double, py::array::c_style>& x) {
-            auto _x = adapt_x(x);
-            auto t = self.tabulate(n, _x);
-            auto t_swap = xt::transpose(t, {0, 1, 3, 2});
-            xt::xtensor<double, 3> t_reshape
-                = xt::reshape_view(t_swap, {t_swap.shape(0), t_swap.shape(1),
-                                            t_swap.shape(2) * t_swap.shape(3)});
-            return py::array_t<double>(t_reshape.shape(), t_reshape.data());
+             const py::array_t<double, py::array::c_style>& x,
+             int num_threads) {
+            // Write (derivative, point, value, dof) directly, which is
+            // the (derivative, point, value * dof) table
+            const std::size_t npts = x.shape(0);
+            std::vector<std::size_t> shape
+                = self.tabulate_shape(n, npts, layout::type::pointValueDof);
+            return tabulate_element(self, n, x, num_threads,
+                                    layout::type::pointValueDof,
+                                    {shape[0], shape[1], shape[2] * shape[3]});
           },
+          py::arg("n"), py::arg("x"), py::arg("num_threads") = 1,
           tabdoc.c_str())
       .def(
           "tabulate_x",
           [](const FiniteElement& self, int n,
+             const py::array_t<double, py::array::c_style>& x, int num_threads,
+             layout::type layout) {
+            return tabulate_element(self, n, x, num_threads, layout,
+                                    self.tabulate_shape(n, x.shape(0), layout));
+          },
+          py::arg("n"), py::arg("x"), py::arg("num_threads") = 1,
+          py::arg("layout") = layout::type::pointDofValue, tabdoc.c_str())
+      .def(
+          "tabulate_x",
+          [](const FiniteElement& self, int n,
+             const py::array_t<float, py::array::c_style>& x, int num_threads,
+             layout::type layout) {
+            return tabulate_element(self, n, x, num_threads, layout,
+                                    self.tabulate_shape(n, x.shape(0), layout));
+          },
+          py::arg("n"), py::arg("x"), py::arg("num_threads") = 1,
+          py::arg("layout") = layout::type::pointDofValue, tabdoc.c_str())
+      .def(
+          "tabulate_into",
+          [](const FiniteElement& self, int n,
+             const py::array_t<double, py::array::c_style>& x,
+             py::array_t<double, py::array::c_style>& basis_data,
+             TabulateWorkspace<double>& w, layout::type layout) {
+            const std::array<std::size_t, 2> xshape
+                = {(std::size_t)x.shape(0),
+                   x.ndim() == 1 ? 1 : (std::size_t)x.shape(1)};
+            self.tabulate(
+                n, xtl::span<const double>(x.data(), x.size()), xshape,
+                xtl::span<double>(basis_data.mutable_data(),
+                                  basis_data.size()),
+                w, layout);
+          },
+          py::arg("n"), py::arg("x"), py::arg("basis_data").noconvert(),
+          py::arg("workspace"),
+          py::arg("layout") = layout::type::pointDofValue,
+          "Tabulate the basis functions and their derivatives into an "
+          "existing C-contiguous float64 array with the shape returned by "
+          "tabulate_x, reusing the memory in the workspace")
+      .def(
+          "tabulate_derivatives",
+          [](const FiniteElement& self,
+             const std::vector<std::array<int, 3>>& derivs,
              const py::array_t<double, py::array::c_style>& x) {
-            auto _x = adapt_x(x);
-            auto t = self.tabulate(n, _x);
+            const std::array<std::size_t, 2> xshape
+                = {(std::size_t)x.shape(0),
+                   x.ndim() == 1 ? 1 : (std::size_t)x.shape(1)};
+            py::array_t<double> t(
+                std::vector<std::size_t>{derivs.size(), xshape[0],
+                                         (std::size_t)self.dim(),
+                                         (std::size_t)self.value_size()});
+            TabulateWorkspace<double> w;
+            self.tabulate(derivs, xtl::span<const double>(x.data(), x.size()),
+                          xshape, xtl::span<double>(t.mutable_data(), t.size()),
+                          w);
+            return t;
+          },
+          "Tabulate a list of derivatives, given as (x, y, z) multi-indices, "
+          "of the basis functions at points. The shape of the result is "
+          "(derivative, point, basis fn index, value index).")
+      .def(
+          "tabulate_dofs",
+          [](const FiniteElement& self, int n, const std::vector<int>& dofs,
+             const py::array_t<double, py::array::c_style>& x) {
+            const std::array<std::size_t, 2> xshape
+                = {(std::size_t)x.shape(0),
+                   x.ndim() == 1 ? 1 : (std::size_t)x.shape(1)};
+            std::vector<std::size_t> shape = self.tabulate_shape(
+                n, xshape[0], layout::type::pointDofValue);
+            shape[2] = dofs.size();
+            py::array_t<double> t(shape);
+            TabulateWorkspace<double> w;
+            self.tabulate(n, dofs, xtl::span<const double>(x.data(), x.size()),
+                          xshape, xtl::span<double>(t.mutable_data(), t.size()),
+                          w);
+            return t;
+          },
+          "Tabulate a subset of the basis functions, and derivatives, at "
+          "points. The shape of the result is (derivative, point, basis fn "
+          "index, value index).")
+      .def(
+          "tabulate_entity_closure",
+          [](const FiniteElement& self, int n, int entity_dim,
+             int entity_index,
+             const py::array_t<double, py::array::c_style>& x) {
+            auto t = self.tabulate_entity_closure(n, entity_dim, entity_index,
+                                                  adapt_x(x));
             return py::array_t<double>(t.shape(), t.data());
           },
-          tabdoc.c_str())
+          "Tabulate the basis functions associated with the closure of a "
+          "sub-entity, and derivatives, at points. The shape of the result "
+          "is (derivative, point, basis fn index, value index).")
+      .def(
+          "tabulate_sub_entities",
+          [](const FiniteElement& self, int n, int dim,
+             const py::array_t<double, py::array::c_style>& x)
+          { return tabulate_sub_entities(self, n, dim, x); },
+          "Tabulate the basis functions, and derivatives, at points on the "
+          "reference sub-entity mapped onto each sub-entity of the given "
+          "dimension. The shape of the result is (sub-entity, derivative, "
+          "point, basis fn index, value index).")
+      .def(
+          "tabulate_facets",
+          [](const FiniteElement& self, int n,
+             const py::array_t<double, py::array::c_style>& x)
+          {
+            const int tdim = cell::topological_dimension(self.cell_type());
+            return tabulate_sub_entities(self, n, tdim - 1, x);
+          },
+          "Tabulate the basis functions, and derivatives, at points on the "
+          "reference facet mapped onto each facet. The shape of the result "
+          "is (facet, derivative, point, basis fn index, value index).")
+      .def(
+          "tabulate_physical",
+          [](const FiniteElement& self, int n,
+             const py::array_t<double, py::array::c_style>& x,
+             const py::array_t<double, py::array::c_style>& J,
+             const py::array_t<double, py::array::c_style>& detJ,
+             const py::array_t<double, py::array::c_style>& K,
+             const py::array_t<std::uint32_t, py::array::c_style>& cell_info)
+          {
+            const std::array<std::size_t, 2> xshape
+                = {(std::size_t)x.shape(0),
+                   x.ndim() == 1 ? 1 : (std::size_t)x.shape(1)};
+            if (J.ndim() != 4)
+              throw std::runtime_error("J must have dimension 4.");
+
+            // The physical value size depends on the geometric dimension
+            std::vector<std::size_t> shape = self.tabulate_shape(
+                n, xshape[0], layout::type::pointDofValue);
+            const std::size_t gdim = J.shape(2);
+            if (self.mapping_type() == maps::type::covariantPiola
+                or self.mapping_type() == maps::type::contravariantPiola)
+            {
+              shape.back() = gdim;
+            }
+            else if (self.mapping_type() != maps::type::identity)
+              shape.back() = gdim * gdim;
+            shape.insert(shape.begin(), cell_info.size());
+
+            py::array_t<double> t(shape);
+            TabulateWorkspace<double> w;
+            self.tabulate_physical(
+                n, xtl::span<const double>(x.data(), x.size()), xshape,
+                xtl::span<const double>(J.data(), J.size()),
+                xtl::span<const double>(detJ.data(), detJ.size()),
+                xtl::span<const double>(K.data(), K.size()),
+                xtl::span<const std::uint32_t>(cell_info.data(),
+                                               cell_info.size()),
+                xtl::span<double>(t.mutable_data(), t.size()), w);
+            return t;
+          },
+          py::arg("n"), py::arg("x"), py::arg("J"), py::arg("detJ"),
+          py::arg("K"), py::arg("cell_info"),
+          "Tabulate the basis functions, and derivatives, on a batch of "
+          "physical cells, applying the DOF transformation and the push "
+          "forward. J has shape (cell, point, gdim, tdim). The shape of the "
+          "result is (cell, derivative, point, basis fn index, physical "
+          "value index).")
+      .def(
+          "tabulate_tensor_factors",
+          [](const FiniteElement& self, int n,
+             const std::vector<py::array_t<double, py::array::c_style>>& x)
+          {
+            std::vector<xt::xtensor<double, 1>> _x;
+            for (auto& xi : x)
+            {
+              std::array<std::size_t, 1> s = {(std::size_t)xi.size()};
+              _x.emplace_back(
+                  xt::adapt(xi.data(), xi.size(), xt::no_ownership(), s));
+            }
+            auto [tables, factors] = self.tabulate_tensor_factors(n, _x);
+            std::vector<py::array_t<double>> t;
+            for (auto& table : tables)
+              t.push_back(py::array_t<double>(table.shape(), table.data()));
+            return std::pair(t,
+                             py::array_t<int>(factors.shape(), factors.data()));
+          },
+          "Tabulate the one-dimensional factors of the basis functions on "
+          "a tensor-product set of points")
       .def(
           "map_push_forward",
           [](const FiniteElement& self,
@@ -327,6 +588,123 @@ Interface to the Basix C++ library.
             return py::array_t<double>(U.shape(), U.data());
           },
           invmapdoc.c_str())
+      .def(
+          "map_push_forward_affine",
+          [](const FiniteElement& self,
+             const py::array_t<double, py::array::c_style>& U,
+             const py::array_t<double, py::array::c_style>& J, double detJ,
+             const py::array_t<double, py::array::c_style>& K) {
+            // The last axis is the value index, which is mapped to the
+            // physical value size
+            std::vector<std::size_t> shape(U.shape(), U.shape() + U.ndim());
+            if (self.mapping_type() == maps::type::covariantPiola
+                or self.mapping_type() == maps::type::contravariantPiola)
+            {
+              shape.back() = J.shape(0);
+            }
+            else if (self.mapping_type() != maps::type::identity)
+              shape.back() = J.shape(0) * J.shape(0);
+            py::array_t<double, py::array::c_style> u(shape);
+            self.map_push_forward_affine(
+                xtl::span<const double>(U.data(), U.size()), adapt_x(J), detJ,
+                adapt_x(K), xtl::span<double>(u.mutable_data(), u.size()));
+            return u;
+          },
+          "Map values, with the value index last, from the reference to a "
+          "physical cell with an affine geometry")
+      .def(
+          "map_pull_back_affine",
+          [](const FiniteElement& self,
+             const py::array_t<double, py::array::c_style>& u,
+             const py::array_t<double, py::array::c_style>& J, double detJ,
+             const py::array_t<double, py::array::c_style>& K) {
+            std::vector<std::size_t> shape(u.shape(), u.shape() + u.ndim());
+            if (self.mapping_type() != maps::type::identity)
+              shape.back() = self.value_size();
+            py::array_t<double, py::array::c_style> U(shape);
+            self.map_pull_back_affine(
+                xtl::span<const double>(u.data(), u.size()), adapt_x(J), detJ,
+                adapt_x(K), xtl::span<double>(U.mutable_data(), U.size()));
+            return U;
+          },
+          "Map values, with the value index last, from a physical cell with "
+          "an affine geometry to the reference")
+      .def(
+          "map_push_forward_derivatives",
+          [](const FiniteElement& self, int n,
+             const py::array_t<double, py::array::c_style>& U,
+             const py::array_t<double, py::array::c_style>& J,
+             const py::array_t<double, py::array::c_style>& detJ,
+             const py::array_t<double, py::array::c_style>& K,
+             const py::array_t<double, py::array::c_style>& dJ) {
+            if (U.ndim() != 4 or J.ndim() != 3)
+              throw std::runtime_error("U and J must have dimension 4 and 3.");
+
+            // The derivatives are with respect to the gdim physical
+            // coordinates
+            const std::size_t gdim = J.shape(1);
+            const std::array<cell::type, 3> simplex
+                = {cell::type::interval, cell::type::triangle,
+                   cell::type::tetrahedron};
+            if (gdim < 1 or gdim > 3)
+              throw std::runtime_error("Unsupported geometric dimension.");
+            std::vector<std::size_t> shape(U.shape(), U.shape() + U.ndim());
+            shape[0] = polyset::nderivs(simplex[gdim - 1], n);
+            if (self.mapping_type() == maps::type::covariantPiola
+                or self.mapping_type() == maps::type::contravariantPiola)
+            {
+              shape.back() = gdim;
+            }
+            else if (self.mapping_type() != maps::type::identity)
+              shape.back() = gdim * gdim;
+
+            py::array_t<double, py::array::c_style> u(shape);
+            self.map_push_forward_derivatives(
+                n, xtl::span<const double>(U.data(), U.size()), U.shape(1),
+                xtl::span<const double>(J.data(), J.size()),
+                xtl::span<const double>(detJ.data(), detJ.size()),
+                xtl::span<const double>(K.data(), K.size()),
+                xtl::span<const double>(dJ.data(), dJ.size()),
+                xtl::span<double>(u.mutable_data(), u.size()));
+            return u;
+          },
+          py::arg("n"), py::arg("U"), py::arg("J"), py::arg("detJ"),
+          py::arg("K"), py::arg("dJ"),
+          "Map a table of basis functions and their derivatives, with "
+          "shape (derivative, point, basis fn index, value index), to a "
+          "physical cell. The derivatives are with respect to the physical "
+          "coordinates. dJ holds the derivatives of J, with shape "
+          "(derivative, point, gdim, tdim), or is empty for an affine cell.")
+      .def(
+          "interpolate_batch",
+          [](const FiniteElement& self,
+             const py::array_t<double, py::array::c_style>& values,
+             const py::array_t<double, py::array::c_style>& J,
+             const py::array_t<double, py::array::c_style>& detJ,
+             const py::array_t<double, py::array::c_style>& K,
+             const py::array_t<std::uint32_t, py::array::c_style>& cell_info)
+          {
+            const std::size_t num_cells = values.ndim() > 0 ? values.shape(0)
+                                                            : 0;
+            py::array_t<double, py::array::c_style> dofs(
+                std::vector<std::size_t>{num_cells, (std::size_t)self.dim()});
+            self.interpolate_batch(
+                xtl::span<const double>(values.data(), values.size()),
+                xtl::span<const double>(J.data(), J.size()),
+                xtl::span<const double>(detJ.data(), detJ.size()),
+                xtl::span<const double>(K.data(), K.size()),
+                xtl::span<const std::uint32_t>(cell_info.data(),
+                                               cell_info.size()),
+                xtl::span<double>(dofs.mutable_data(), dofs.size()));
+            return dofs;
+          },
+          py::arg("values"), py::arg("J"), py::arg("detJ"), py::arg("K"),
+          py::arg("cell_info"),
+          "Interpolate a function into the element on a batch of cells, "
+          "given its values at the interpolation points of each cell with "
+          "shape (cell, point, physical value index). The DOF "
+          "transformations are applied if cell_info is not empty. The "
+          "shape of the result is (cell, dof).")
       .def("apply_dof_transformation",
            [](const FiniteElement& self, py::array_t<double>& data,
               int block_size, std::uint32_t cell_info) {
@@ -350,6 +728,176 @@ Interface to the Basix C++ library.
                  data_span, block_size, cell_info);
              return py::array_t<double>(data_span.size(), data_span.data());
            })
+      .def("apply_transpose_dof_transformation",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              int block_size, std::uint32_t cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_transpose_dof_transformation(data_span, block_size,
+                                                     cell_info);
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_inverse_dof_transformation",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              int block_size, std::uint32_t cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_inverse_dof_transformation(data_span, block_size,
+                                                   cell_info);
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_transpose_dof_transformation_to_transpose",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              int block_size, std::uint32_t cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_transpose_dof_transformation_to_transpose(
+                 data_span, block_size, cell_info);
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_inverse_transpose_dof_transformation_to_transpose",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              int block_size, std::uint32_t cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_inverse_transpose_dof_transformation_to_transpose(
+                 data_span, block_size, cell_info);
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_inverse_dof_transformation_to_transpose",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              int block_size, std::uint32_t cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_inverse_dof_transformation_to_transpose(
+                 data_span, block_size, cell_info);
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_dof_transformation_batch",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              std::size_t stride, int block_size,
+              const py::array_t<std::uint32_t, py::array::c_style>& cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_dof_transformation_batch(
+                 data_span, cell_info.size(), stride, block_size,
+                 xtl::span<const std::uint32_t>(cell_info.data(),
+                                                cell_info.size()));
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_inverse_transpose_dof_transformation_batch",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              std::size_t stride, int block_size,
+              const py::array_t<std::uint32_t, py::array::c_style>& cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_inverse_transpose_dof_transformation_batch(
+                 data_span, cell_info.size(), stride, block_size,
+                 xtl::span<const std::uint32_t>(cell_info.data(),
+                                                cell_info.size()));
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_transpose_dof_transformation_batch",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              std::size_t stride, int block_size,
+              const py::array_t<std::uint32_t, py::array::c_style>& cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_transpose_dof_transformation_batch(
+                 data_span, cell_info.size(), stride, block_size,
+                 xtl::span<const std::uint32_t>(cell_info.data(),
+                                                cell_info.size()));
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_inverse_dof_transformation_batch",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              std::size_t stride, int block_size,
+              const py::array_t<std::uint32_t, py::array::c_style>& cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_inverse_dof_transformation_batch(
+                 data_span, cell_info.size(), stride, block_size,
+                 xtl::span<const std::uint32_t>(cell_info.data(),
+                                                cell_info.size()));
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_dof_transformation_to_transpose_batch",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              std::size_t stride, int block_size,
+              const py::array_t<std::uint32_t, py::array::c_style>& cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_dof_transformation_to_transpose_batch(
+                 data_span, cell_info.size(), stride, block_size,
+                 xtl::span<const std::uint32_t>(cell_info.data(),
+                                                cell_info.size()));
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_transpose_dof_transformation_to_transpose_batch",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              std::size_t stride, int block_size,
+              const py::array_t<std::uint32_t, py::array::c_style>& cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_transpose_dof_transformation_to_transpose_batch(
+                 data_span, cell_info.size(), stride, block_size,
+                 xtl::span<const std::uint32_t>(cell_info.data(),
+                                                cell_info.size()));
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_inverse_transpose_dof_transformation_to_transpose_batch",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              std::size_t stride, int block_size,
+              const py::array_t<std::uint32_t, py::array::c_style>& cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_inverse_transpose_dof_transformation_to_transpose_batch(
+                 data_span, cell_info.size(), stride, block_size,
+                 xtl::span<const std::uint32_t>(cell_info.data(),
+                                                cell_info.size()));
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def("apply_inverse_dof_transformation_to_transpose_batch",
+           [](const FiniteElement& self, py::array_t<double>& data,
+              std::size_t stride, int block_size,
+              const py::array_t<std::uint32_t, py::array::c_style>& cell_info) {
+             xtl::span<double> data_span(data.mutable_data(), data.size());
+             self.apply_inverse_dof_transformation_to_transpose_batch(
+                 data_span, cell_info.size(), stride, block_size,
+                 xtl::span<const std::uint32_t>(cell_info.data(),
+                                                cell_info.size()));
+             return py::array_t<double>(data_span.size(), data_span.data());
+           })
+      .def(
+          "transform_element_matrix",
+          [](const FiniteElement& self,
+             const py::array_t<double, py::array::c_style>& A,
+             const std::vector<std::uint32_t>& cell_info0,
+             const std::vector<std::uint32_t>& cell_info1,
+             doftransform::type type, int block_size) {
+            py::array_t<double, py::array::c_style> B(
+                std::vector<std::size_t>(A.shape(), A.shape() + A.ndim()));
+            std::copy_n(A.data(), A.size(), B.mutable_data());
+            self.transform_element_matrix(
+                xtl::span<double>(B.mutable_data(), B.size()), cell_info0,
+                cell_info1, type, block_size);
+            return B;
+          },
+          py::arg("A"), py::arg("cell_info0"), py::arg("cell_info1"),
+          py::arg("type") = doftransform::type::standard,
+          py::arg("block_size") = 1,
+          "Apply DOF transformations to both sides of an element matrix")
+      .def(
+          "dof_transformation_matrix",
+          [](const FiniteElement& self, std::uint32_t cell_info,
+             doftransform::type type) {
+            std::shared_ptr<const DofTransformationMatrix> M
+                = self.dof_transformation_matrix(cell_info, type);
+            return py::make_tuple(
+                py::array_t<std::int32_t>(M->offsets.size(),
+                                          M->offsets.data()),
+                py::array_t<std::int32_t>(M->columns.size(),
+                                          M->columns.data()),
+                py::array_t<double>(M->values.size(), M->values.data()));
+          },
+          py::arg("cell_info"), py::arg("type") = doftransform::type::standard,
+          "The DOF transformation matrix of a cell in compressed sparse row "
+          "format, as (offsets, columns, values)")
+      .def_property("dof_transformation_cache_size",
+                    &FiniteElement::dof_transformation_cache_size,
+                    &FiniteElement::set_dof_transformation_cache_size,
+                    "The number of DOF transformation matrices kept by the "
+                    "element. Elements from create_element_cached are "
+                    "shared, so setting this changes it for every user of "
+                    "the cached element.")
       .def("base_transformations",
            [](const FiniteElement& self) {
              xt::xtensor<double, 3> t = self.base_transformations();
@@ -405,6 +953,37 @@ Interface to the Basix C++ library.
       { return basix::create_element(family_name, cell_name, degree); },
       "Create a FiniteElement of a given family, celltype and degree");
 
+  m.def(
+      "create_element_cached",
+      [](const std::string family_name, const std::string cell_name,
+         int degree)
+      {
+        // The cached element is const and is shared by every caller.
+        // The only thing Python can change on an element is the size
+        // of its DOF transformation cache, which is guarded by a mutex
+        // and changes how the transformations are applied but not what
+        // they compute, so sharing the element without const is safe.
+        return std::const_pointer_cast<FiniteElement>(
+            basix::create_element_cached(family_name, cell_name, degree));
+      },
+      py::call_guard<py::gil_scoped_release>(),
+      "Create a FiniteElement of a given family, celltype and degree, or "
+      "get it from a cache of elements that have already been created");
+
+  py::class_<ElementCacheStatistics>(m, "ElementCacheStatistics",
+                                     "Statistics of the element cache")
+      .def_readonly("hits", &ElementCacheStatistics::hits)
+      .def_readonly("misses", &ElementCacheStatistics::misses)
+      .def_readonly("size", &ElementCacheStatistics::size)
+      .def_readonly("disk_hits", &ElementCacheStatistics::disk_hits);
+  m.def("element_cache_statistics", &basix::element_cache_statistics,
+        "Get the statistics of the element cache");
+  m.def("clear_element_cache", &basix::clear_element_cache,
+        "Remove all elements from the element cache");
+  m.def("set_element_cache_directory", &basix::set_element_cache_directory,
+        "Set a directory in which the element cache stores elements. Use "
+        "an empty string to stop using a directory.");
+
   m.def(
       "tabulate_polynomial_set",
       [](cell::type celltype, int d, int n,
@@ -470,3 +470,180 @@ def test_transformation_of_tabulated_data_pyramid(element_name, order):
                 j_slice = j[:, d]
                 assert np.allclose((bt[9].dot(i_slice))[start: start + ndofs],
                                    j_slice[start: start + ndofs])
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "tetrahedron", 4),
+    ("Lagrange", "hexahedron", 3),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 2),
+    ("Raviart-Thomas", "hexahedron", 2),
+])
+@pytest.mark.parametrize("block_size", [1, 3])
+def test_apply_dof_transformation(element_name, cell_name, order, block_size):
+    random.seed(7)
+    np.random.seed(7)
+    e = basix.create_element(element_name, cell_name, order)
+    bt = e.base_transformations()
+    num_edges = len(basix.topology(e.cell_type)[1])
+    num_faces = len(basix.topology(e.cell_type)[2])
+
+    for i in range(10):
+        cell_info = random.randrange(2**30)
+
+        # Compose the base transformations for each entity
+        matrix = np.identity(e.dim)
+        for edge in range(num_edges):
+            if cell_info >> (3 * num_faces + edge) & 1:
+                matrix = bt[edge].dot(matrix)
+        for f in range(num_faces):
+            if cell_info >> (3 * f) & 1:
+                matrix = bt[num_edges + 2 * f + 1].dot(matrix)
+            for r in range(cell_info >> (3 * f + 1) & 3):
+                matrix = bt[num_edges + 2 * f].dot(matrix)
+
+        # Check each variant on data with shape (dof, block), and on
+        # transposed data with shape (block, dof)
+        inverse = np.linalg.inv(matrix)
+        variants = {"": matrix, "transpose_": matrix.T, "inverse_": inverse, "inverse_transpose_": inverse.T}
+        for name, M in variants.items():
+            data = np.random.random((e.dim, block_size))
+            result = getattr(e, f"apply_{name}dof_transformation")(data.flatten(), block_size, cell_info)
+            assert np.allclose(result, M.dot(data).flatten())
+
+            data = np.random.random((block_size, e.dim))
+            result = getattr(e, f"apply_{name}dof_transformation_to_transpose")(data.flatten(), block_size, cell_info)
+            assert np.allclose(result, data.dot(M.T).flatten())
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "tetrahedron", 3),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 3),
+    ("Raviart-Thomas", "hexahedron", 2),
+])
+@pytest.mark.parametrize("block_size", [1, 3])
+@pytest.mark.parametrize("cache_size", [0, 8])
+def test_apply_dof_transformation_batch(element_name, cell_name, order, block_size, cache_size):
+    random.seed(11)
+    np.random.seed(11)
+    e = basix.create_element(element_name, cell_name, order)
+    e.dof_transformation_cache_size = cache_size
+
+    # Use few distinct orientations, so that cells share them, and pad
+    # the data of each cell
+    ncells = 40
+    stride = e.dim * block_size + 5
+    orientations = [random.randrange(2**30) for _ in range(6)]
+    cell_info = np.array([random.choice(orientations) for _ in range(ncells)], dtype=np.uint32)
+    data = np.random.random(ncells * stride)
+
+    for name in [f"apply_{prefix}dof_transformation{suffix}"
+                 for prefix in ["", "transpose_", "inverse_", "inverse_transpose_"]
+                 for suffix in ["", "_to_transpose"]]:
+        batch = getattr(e, name + "_batch")(data.copy(), stride, block_size, cell_info)
+        for c in range(ncells):
+            cell_data = data[c * stride: c * stride + e.dim * block_size].copy()
+            expected = getattr(e, name)(cell_data, block_size, int(cell_info[c]))
+            assert np.allclose(batch[c * stride: c * stride + e.dim * block_size], expected)
+            assert np.allclose(batch[c * stride + e.dim * block_size: (c + 1) * stride],
+                               data[c * stride + e.dim * block_size: (c + 1) * stride])
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "tetrahedron", 3),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 3),
+    ("Raviart-Thomas", "hexahedron", 2),
+])
+@pytest.mark.parametrize("ncells", [1, 2])
+@pytest.mark.parametrize("transformation_type", [
+    basix.DofTransformationType.standard,
+    basix.DofTransformationType.transpose,
+    basix.DofTransformationType.inverse,
+    basix.DofTransformationType.inverse_transpose,
+])
+@pytest.mark.parametrize("block_size", [1, 3])
+def test_transform_element_matrix(element_name, cell_name, order, ncells, transformation_type, block_size):
+    random.seed(3)
+    np.random.seed(3)
+    e = basix.create_element(element_name, cell_name, order)
+
+    def matrix(cell_info):
+        # The dense transformation of the given type, with block_size
+        # rows for each DOF
+        T = e.apply_dof_transformation(np.identity(e.dim).flatten(), e.dim, cell_info).reshape(e.dim, e.dim)
+        if transformation_type == basix.DofTransformationType.transpose:
+            T = T.T
+        elif transformation_type == basix.DofTransformationType.inverse:
+            T = np.linalg.inv(T)
+        elif transformation_type == basix.DofTransformationType.inverse_transpose:
+            T = np.linalg.inv(T).T
+        return np.kron(T, np.identity(block_size))
+
+    n = e.dim * block_size
+    for i in range(5):
+        cell_info0 = [random.randrange(2**30) for _ in range(ncells)]
+        cell_info1 = [random.randrange(2**30) for _ in range(ncells)]
+        A = np.random.random((ncells * n, ncells * n))
+
+        expected = A.copy()
+        for c0 in range(ncells):
+            for c1 in range(ncells):
+                block = A[c0 * n: (c0 + 1) * n, c1 * n: (c1 + 1) * n]
+                expected[c0 * n: (c0 + 1) * n, c1 * n: (c1 + 1) * n] = (
+                    matrix(cell_info0[c0]) @ block @ matrix(cell_info1[c1]).T)
+
+        result = e.transform_element_matrix(A, cell_info0, cell_info1, transformation_type, block_size)
+        assert np.allclose(result, expected)
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "triangle", 4),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 3),
+    ("Raviart-Thomas", "hexahedron", 2),
+])
+def test_dof_transformation_matrix(element_name, cell_name, order):
+    random.seed(5)
+    np.random.seed(5)
+    e = basix.create_element(element_name, cell_name, order)
+    e.dof_transformation_cache_size = 4
+
+    for i in range(10):
+        cell_info = random.randrange(2**30)
+        offsets, columns, values = e.dof_transformation_matrix(cell_info)
+        matrix = np.zeros((e.dim, e.dim))
+        for row in range(e.dim):
+            matrix[row, columns[offsets[row]: offsets[row + 1]]] = values[offsets[row]: offsets[row + 1]]
+
+        identity = np.identity(e.dim).flatten()
+        assert np.allclose(matrix, e.apply_dof_transformation(identity, e.dim, cell_info).reshape(e.dim, e.dim))
+
+    # The batched functions give the same result with and without the
+    # cached matrices
+    cell_info = np.array([random.randrange(2**30) for _ in range(3)] * 4, dtype=np.uint32)
+    data = np.random.random(len(cell_info) * e.dim * 2)
+    with_cache = e.apply_dof_transformation_batch(data.copy(), e.dim * 2, 2, cell_info)
+    e.dof_transformation_cache_size = 0
+    without_cache = e.apply_dof_transformation_batch(data.copy(), e.dim * 2, 2, cell_info)
+    assert np.allclose(with_cache, without_cache)
+
+
+@pytest.mark.parametrize("element_name, unused_bits", [
+    ("Nedelec 1st kind H(curl)", 2**12 - 1),  # No DOFs on the faces
+    ("Raviart-Thomas", (2**6 - 1) << 12),  # No DOFs on the edges
+])
+def test_dof_transformation_matrix_unused_bits(element_name, unused_bits):
+    random.seed(5)
+    e = basix.create_element(element_name, "tetrahedron", 1)
+    e.dof_transformation_cache_size = 4
+
+    for i in range(10):
+        cell_info = random.randrange(2**18)
+        m0 = e.dof_transformation_matrix(cell_info & ~unused_bits)
+        m1 = e.dof_transformation_matrix(cell_info | unused_bits)
+        for a0, a1 in zip(m0, m1):
+            assert np.array_equal(a0, a1)
+
+    # The batched functions give the same result as transforming each cell
+    data = np.random.random((20, e.dim))
+    cell_info = np.array([random.randrange(2**18) for _ in range(20)], dtype=np.uint32)
+    expected = np.array([e.apply_dof_transformation(d.copy(), 1, int(c)) for d, c in zip(data, cell_info)])
+    assert np.allclose(e.apply_dof_transformation_batch(data.flatten(), e.dim, 1, cell_info), expected.flatten())
@@ -0,0 +1,48 @@
+import basix
+import numpy as np
+import pytest
+from concurrent.futures import ThreadPoolExecutor
+
+
+def test_cache():
+    basix.clear_element_cache()
+    e0 = basix.create_element_cached("Lagrange", "triangle", 2)
+    e1 = basix.create_element_cached("Lagrange", "triangle", 2)
+    e2 = basix.create_element_cached("Lagrange", "triangle", 3)
+    assert e0 is e1
+    assert e0 is not e2
+
+    stats = basix.element_cache_statistics()
+    assert stats.hits == 1
+    assert stats.misses == 2
+    assert stats.size == 2
+
+    e = basix.create_element("Lagrange", "triangle", 2)
+    pts = basix.create_lattice(basix.CellType.triangle, 3, basix.LatticeType.equispaced, True)
+    assert np.allclose(e.tabulate(1, pts), e0.tabulate(1, pts))
+
+    basix.clear_element_cache()
+    stats = basix.element_cache_statistics()
+    assert stats.hits == 0 and stats.misses == 0 and stats.size == 0
+    assert e0.dim == e.dim
+
+
+def test_cache_threads():
+    basix.clear_element_cache()
+
+    def create(i):
+        return basix.create_element_cached("Nedelec 1st kind H(curl)", "tetrahedron", 1 + i % 2)
+
+    with ThreadPoolExecutor(8) as pool:
+        elements = list(pool.map(create, range(32)))
+    assert all(e is elements[i % 2] for i, e in enumerate(elements))
+    stats = basix.element_cache_statistics()
+    assert stats.misses == 2
+    assert stats.hits == 30
+
+
+def test_cache_invalid():
+    basix.clear_element_cache()
+    with pytest.raises(RuntimeError):
+        basix.create_element_cached("Crouzeix-Raviart", "triangle", 2)
+    assert basix.element_cache_statistics().size == 0
@@ -38,3 +38,38 @@ def test_interpolation_matrix(cell_name, order, element_name):
         coeffs[i, :] = i_m @ tabulated[:, i::i_m.shape[0]].T.reshape(i_m.shape[1])
 
     assert np.allclose(coeffs, np.identity(coeffs.shape[0]))
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "triangle", 3),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 2),
+    ("Raviart-Thomas", "quadrilateral", 2),
+    ("Regge", "triangle", 1),
+])
+@pytest.mark.parametrize("transform", [True, False])
+def test_interpolate_batch(element_name, cell_name, order, transform):
+    np.random.seed(9)
+    element = basix.create_element(element_name, cell_name, order)
+    tdim = len(basix.topology(element.cell_type)) - 1
+    npts = element.points.shape[0]
+
+    # Use enough cells to give several blocks, with a different
+    # Jacobian at each point
+    ncells = 300
+    J = np.random.random((ncells, npts, tdim, tdim)) * 0.2 + np.eye(tdim)
+    detJ = np.linalg.det(J)
+    K = np.linalg.inv(J)
+    pvs = element.value_size
+    values = np.random.random((ncells, npts, pvs))
+    cell_info = np.random.randint(2**30, size=ncells if transform else 0).astype(np.uint32)
+
+    dofs = element.interpolate_batch(values, J, detJ, K, cell_info)
+    assert dofs.shape == (ncells, element.dim)
+
+    # Compare with pulling back and interpolating on each cell
+    for c in range(ncells):
+        U = element.map_pull_back(values[c].reshape(npts, 1, pvs), J[c], detJ[c], K[c])
+        expected = element.interpolation_matrix @ U[:, 0, :].T.flatten()
+        if transform:
+            expected = element.apply_inverse_transpose_dof_transformation(expected, 1, int(cell_info[c]))
+        assert np.allclose(dofs[c], expected)
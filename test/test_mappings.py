@@ -42,6 +42,10 @@ def run_map_test(e, J, detJ, K, reference_value_size, physical_value_size):
     unmapped = e.map_pull_back(mapped, _J, _detJ, _K)
     assert np.allclose(values, unmapped)
 
+    # The map for an affine cell gives the same values
+    assert np.allclose(e.map_push_forward_affine(values, J, detJ, K), mapped)
+    assert np.allclose(e.map_pull_back_affine(mapped, J, detJ, K), values)
+
 
 @pytest.mark.parametrize("element_name", elements)
 def test_mappings_2d_to_2d(element_name):
@@ -82,3 +86,72 @@ def test_mappings_3d_to_3d(element_name):
     K = np.linalg.inv(J)
 
     run_map_test(e, J, detJ, K, e.value_size, e.value_size)
+
+
+@pytest.mark.parametrize("element_name", elements)
+@pytest.mark.parametrize("cell_name", ["triangle", "tetrahedron"])
+@pytest.mark.parametrize("affine", [True, False])
+def test_push_forward_derivatives(element_name, cell_name, affine):
+    np.random.seed(2)
+    e = basix.create_element(element_name, cell_name, 2)
+    tdim = len(basix.topology(e.cell_type)) - 1
+
+    # The geometry x_i = B_ik X_k + Q_ik X_k^3 / 3 + c_i X_0 X_1
+    B = np.random.random((tdim, tdim)) * 0.3 + np.eye(tdim)
+    Q = np.zeros((tdim, tdim)) if affine else np.random.random((tdim, tdim)) * 0.3
+    c = np.zeros(tdim) if affine else np.random.random(tdim) * 0.3
+
+    def jacobian(X):
+        J = B + Q * X ** 2
+        J[:, 0] += c * X[1]
+        J[:, 1] += c * X[0]
+        return J
+
+    def jacobian_derivative(X, k, l=None):
+        d = np.zeros((tdim, tdim))
+        if l is None:
+            d[:, k] = 2 * Q[:, k] * X[k]
+            if k < 2:
+                d[:, 1 - k] += c
+        elif k == l:
+            d[:, k] = 2 * Q[:, k]
+        return d
+
+    def index(*dirs):
+        return basix.index(*[dirs.count(i) for i in range(tdim)])
+
+    def push_forward(X):
+        J = jacobian(X)
+        return e.map_push_forward(e.tabulate_x(0, np.array([X]))[0], np.array([J]),
+                                  np.array([np.linalg.det(J)]), np.array([np.linalg.inv(J)]))[0]
+
+    X = np.random.random(tdim) / tdim
+    J = jacobian(X)
+    ek = np.eye(tdim)
+    dJ = np.zeros(0)
+    if not affine:
+        dJ = np.zeros((len(e.tabulate_x(2, np.array([X]))) - 1, 1, tdim, tdim))
+        for k in range(tdim):
+            dJ[k, 0] = jacobian_derivative(X, k)
+            for l in range(k, tdim):
+                dJ[index(k, l) - 1, 0] = jacobian_derivative(X, k, l)
+
+    u = e.map_push_forward_derivatives(2, e.tabulate_x(2, np.array([X])), np.array([J]),
+                                       np.array([np.linalg.det(J)]), np.array([np.linalg.inv(J)]), dJ)
+    assert np.allclose(u[0, 0], push_forward(X))
+
+    # Compare d/dX_k and d2/dX_k dX_l of the mapped values with the
+    # chain rule applied to the physical derivatives
+    h = 1e-3
+    for k in range(tdim):
+        fd = (push_forward(X + h * ek[k]) - push_forward(X - h * ek[k])) / (2 * h)
+        grad = sum(J[j, k] * u[index(j), 0] for j in range(tdim))
+        assert np.allclose(fd, grad, atol=1e-5)
+        for l in range(tdim):
+            fd = (push_forward(X + h * ek[k] + h * ek[l]) - push_forward(X + h * ek[k] - h * ek[l])
+                  - push_forward(X - h * ek[k] + h * ek[l]) + push_forward(X - h * ek[k] - h * ek[l])) / (4 * h * h)
+            hess = sum(J[i, k] * J[j, l] * u[index(i, j), 0]
+                       for i in range(tdim) for j in range(tdim))
+            hess += sum(jacobian_derivative(X, l)[j, k] * u[index(j), 0]
+                        for j in range(tdim))
+            assert np.allclose(fd, hess, atol=1e-4)
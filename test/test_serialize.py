@@ -0,0 +1,91 @@
+import basix
+import numpy as np
+import pickle
+import pytest
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "triangle", 3),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 2),
+    ("Regge", "tetrahedron", 1),
+    ("Raviart-Thomas", "quadrilateral", 2),
+    ("Lagrange", "prism", 2),
+])
+def test_pickle(element_name, cell_name, order):
+    e = basix.create_element(element_name, cell_name, order)
+    e2 = pickle.loads(pickle.dumps(e))
+
+    assert e2.family == e.family
+    assert e2.cell_type == e.cell_type
+    assert e2.degree == e.degree
+    assert e2.dim == e.dim
+    assert e2.value_shape == e.value_shape
+    assert e2.entity_dofs == e.entity_dofs
+    assert np.array_equal(e2.points, e.points)
+    assert np.array_equal(e2.interpolation_matrix, e.interpolation_matrix)
+    assert np.array_equal(e2.base_transformations(), e.base_transformations())
+
+    tdim = len(basix.topology(e.cell_type)) - 1
+    pts = np.random.random((10, tdim)) / tdim
+    assert np.array_equal(e2.tabulate(1, pts), e.tabulate(1, pts))
+
+
+def test_cache_directory(tmp_path):
+    basix.clear_element_cache()
+    basix.set_element_cache_directory(str(tmp_path))
+    try:
+        e0 = basix.create_element_cached("Nedelec 1st kind H(curl)", "tetrahedron", 2)
+        assert basix.element_cache_statistics().disk_hits == 0
+        assert len(list(tmp_path.iterdir())) == 1
+
+        basix.clear_element_cache()
+        e1 = basix.create_element_cached("Nedelec 1st kind H(curl)", "tetrahedron", 2)
+        assert basix.element_cache_statistics().disk_hits == 1
+        assert e1 is not e0
+        assert np.array_equal(e0.base_transformations(), e1.base_transformations())
+    finally:
+        basix.set_element_cache_directory("")
+        basix.clear_element_cache()
+
+
+def test_corrupt_cache_file(tmp_path):
+    basix.clear_element_cache()
+    basix.set_element_cache_directory(str(tmp_path))
+    try:
+        basix.create_element_cached("Lagrange", "triangle", 2)
+        for f in tmp_path.iterdir():
+            f.write_bytes(f.read_bytes()[:20])
+
+        basix.clear_element_cache()
+        e = basix.create_element_cached("Lagrange", "triangle", 2)
+        assert basix.element_cache_statistics().disk_hits == 0
+        assert e.dim == 6
+    finally:
+        basix.set_element_cache_directory("")
+        basix.clear_element_cache()
+
+
+@pytest.mark.parametrize("offset, value", [
+    (16, 99),  # Cell type
+    (20, -1),  # Degree
+    (28, 2**62),  # Number of value shape entries
+    (36, 2**40),  # Value size
+])
+def test_corrupt_cache_data(tmp_path, offset, value):
+    basix.clear_element_cache()
+    basix.set_element_cache_directory(str(tmp_path))
+    try:
+        basix.create_element_cached("Lagrange", "triangle", 2)
+        for f in tmp_path.iterdir():
+            data = bytearray(f.read_bytes())
+            size = 4 if offset < 28 else 8
+            data[offset:offset + size] = value.to_bytes(size, "little", signed=True)
+            f.write_bytes(bytes(data))
+
+        basix.clear_element_cache()
+        e = basix.create_element_cached("Lagrange", "triangle", 2)
+        assert basix.element_cache_statistics().disk_hits == 0
+        assert e.dim == 6
+    finally:
+        basix.set_element_cache_directory("")
+        basix.clear_element_cache()
@@ -0,0 +1,36 @@
+import basix
+import numpy as np
+import pytest
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "interval", 3),
+    ("Lagrange", "triangle", 3),
+    ("Lagrange", "quadrilateral", 2),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 2),
+    ("Lagrange", "prism", 2),
+    ("Lagrange", "pyramid", 2),
+    ("Lagrange", "hexahedron", 2),
+])
+def test_derivative_subset(element_name, cell_name, order):
+    e = basix.create_element(element_name, cell_name, order)
+    tdim = len(basix.topology(e.cell_type)) - 1
+
+    np.random.seed(2)
+    pts = np.random.random((20, tdim)) / tdim
+
+    tab = e.tabulate_x(3, pts)
+    if tdim == 1:
+        derivs = [(2, 0, 0), (1, 0, 0), (3, 0, 0)]
+        indices = [basix.index(d[0]) for d in derivs]
+    elif tdim == 2:
+        derivs = [(1, 1, 0), (0, 1, 0), (2, 1, 0)]
+        indices = [basix.index(d[0], d[1]) for d in derivs]
+    else:
+        derivs = [(0, 1, 1), (1, 0, 0), (0, 0, 2), (1, 1, 1)]
+        indices = [basix.index(d[0], d[1], d[2]) for d in derivs]
+
+    t = e.tabulate_derivatives(derivs, pts)
+    assert t.shape == (len(derivs), ) + tab.shape[1:]
+    for i, j in enumerate(indices):
+        assert np.allclose(t[i], tab[j])
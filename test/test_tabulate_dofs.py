@@ -0,0 +1,38 @@
+import basix
+import numpy as np
+import pytest
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "triangle", 3),
+    ("Lagrange", "tetrahedron", 5),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 2),
+    ("Lagrange", "hexahedron", 2),
+])
+def test_entity_closure(element_name, cell_name, order):
+    e = basix.create_element(element_name, cell_name, order)
+    tdim = len(basix.topology(e.cell_type)) - 1
+
+    np.random.seed(3)
+    pts = np.random.random((10, tdim)) / tdim
+    tab = e.tabulate_x(1, pts)
+
+    for f, closure in enumerate(e.entity_closure_dofs[tdim - 1]):
+        dofs = sorted(closure)
+        t = e.tabulate_entity_closure(1, tdim - 1, f, pts)
+        assert t.shape == (tab.shape[0], tab.shape[1], len(dofs), tab.shape[3])
+        assert np.allclose(t, tab[:, :, dofs, :])
+
+
+def test_dofs():
+    e = basix.create_element("Raviart-Thomas", "triangle", 2)
+    np.random.seed(5)
+    pts = np.random.random((7, 2)) / 2
+    tab = e.tabulate_x(2, pts)
+
+    dofs = [5, 0, 3, 3]
+    t = e.tabulate_dofs(2, dofs, pts)
+    assert np.allclose(t, tab[:, :, dofs, :])
+
+    with pytest.raises(RuntimeError):
+        e.tabulate_dofs(0, [e.dim], pts)
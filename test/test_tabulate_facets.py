@@ -0,0 +1,67 @@
+import basix
+import numpy as np
+import pytest
+
+
+@pytest.mark.parametrize("element_name, cell_name, order, dim", [
+    ("Lagrange", "interval", 2, 0),
+    ("Lagrange", "triangle", 3, 1),
+    ("Nedelec 1st kind H(curl)", "triangle", 2, 1),
+    ("Raviart-Thomas", "tetrahedron", 2, 2),
+    ("Lagrange", "tetrahedron", 2, 1),
+    ("Lagrange", "quadrilateral", 2, 1),
+    ("Lagrange", "hexahedron", 2, 2),
+    ("Lagrange", "prism", 2, 1),
+    ("Lagrange", "prism", 2, 3),
+])
+def test_sub_entities(element_name, cell_name, order, dim):
+    e = basix.create_element(element_name, cell_name, order)
+    geometry = basix.geometry(e.cell_type)
+    entities = basix.topology(e.cell_type)[dim]
+
+    np.random.seed(5)
+    pts = np.random.random((10, dim)) / max(dim, 1)
+
+    tab = e.tabulate_sub_entities(1, dim, pts)
+    assert tab.shape[0] == len(entities)
+    for i, v in enumerate(entities):
+        x = geometry[v[0]] + pts.dot(geometry[v[1:dim + 1]] - geometry[v[0]])
+        assert np.allclose(tab[i], e.tabulate_x(1, x))
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "quadrilateral", 2),
+    ("Lagrange", "hexahedron", 2),
+    ("Raviart-Thomas", "hexahedron", 2),
+    ("Lagrange", "pyramid", 2),
+])
+def test_cell_as_sub_entity(element_name, cell_name, order):
+    e = basix.create_element(element_name, cell_name, order)
+    tdim = len(basix.topology(e.cell_type)) - 1
+
+    np.random.seed(5)
+    pts = np.random.random((10, tdim)) / tdim
+
+    tab = e.tabulate_sub_entities(1, tdim, pts)
+    assert tab.shape[0] == 1
+    assert np.allclose(tab[0], e.tabulate_x(1, pts))
+
+
+@pytest.mark.parametrize("cell_name, facet_type", [
+    ("triangle", basix.CellType.interval),
+    ("tetrahedron", basix.CellType.triangle),
+    ("hexahedron", basix.CellType.quadrilateral),
+])
+def test_facets(cell_name, facet_type):
+    e = basix.create_element("Lagrange", cell_name, 2)
+    tdim = len(basix.topology(e.cell_type)) - 1
+    pts, wts = basix.make_quadrature("default", facet_type, 3)
+
+    assert np.allclose(e.tabulate_facets(2, pts),
+                       e.tabulate_sub_entities(2, tdim - 1, pts))
+
+
+def test_mixed_facets():
+    e = basix.create_element("Lagrange", "prism", 2)
+    with pytest.raises(RuntimeError):
+        e.tabulate_facets(0, np.array([[0.2, 0.3]]))
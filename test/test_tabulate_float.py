@@ -0,0 +1,24 @@
+import basix
+import numpy as np
+import pytest
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "interval", 3),
+    ("Lagrange", "triangle", 3),
+    ("Lagrange", "quadrilateral", 2),
+    ("Raviart-Thomas", "tetrahedron", 2),
+    ("Lagrange", "prism", 2),
+    ("Lagrange", "hexahedron", 2),
+])
+def test_float(element_name, cell_name, order):
+    e = basix.create_element(element_name, cell_name, order)
+    tdim = len(basix.topology(e.cell_type)) - 1
+
+    np.random.seed(4)
+    pts = np.random.random((300, tdim)) / tdim
+
+    tab = e.tabulate_x(1, pts)
+    tab_float = e.tabulate_x(1, pts.astype(np.float32))
+    assert tab_float.dtype == np.float32
+    assert np.allclose(tab, tab_float, atol=1e-4 * np.max(np.abs(tab)))
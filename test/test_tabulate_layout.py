@@ -0,0 +1,39 @@
+import basix
+import numpy as np
+import pytest
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "triangle", 2),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 2),
+    ("Regge", "triangle", 1),
+])
+@pytest.mark.parametrize("npts", [5, 300])
+def test_layouts(element_name, cell_name, order, npts):
+    e = basix.create_element(element_name, cell_name, order)
+    tdim = len(basix.topology(e.cell_type)) - 1
+
+    np.random.seed(7)
+    pts = np.random.random((npts, tdim)) / tdim
+
+    # (derivative, point, dof, value)
+    tab = e.tabulate_x(1, pts)
+
+    t = e.tabulate_x(1, pts, layout=basix.LayoutType.pointValueDof)
+    assert np.allclose(t, tab.transpose(0, 1, 3, 2))
+    t = e.tabulate_x(1, pts, layout=basix.LayoutType.valuePointDof)
+    assert np.allclose(t, tab.transpose(0, 3, 1, 2))
+    t = e.tabulate_x(1, pts, layout=basix.LayoutType.valueDofPoint)
+    assert np.allclose(t, tab.transpose(0, 3, 2, 1))
+
+    # (derivative, point block, value, dof, point in block)
+    t = e.tabulate_x(1, pts, layout=basix.LayoutType.interleaved)
+    nblocks, bs = t.shape[1], t.shape[4]
+    assert nblocks * bs >= npts and (nblocks - 1) * bs < npts
+    t = t.transpose(0, 1, 4, 2, 3).reshape(tab.shape[0], nblocks * bs, e.value_size, e.dim)
+    assert np.allclose(t[:, :npts], tab.transpose(0, 1, 3, 2))
+    assert np.allclose(t[:, npts:], 0.0)
+
+    # The Python tabulate function uses (derivative, point, value * dof)
+    t = e.tabulate(1, pts)
+    assert np.allclose(t, tab.transpose(0, 1, 3, 2).reshape(t.shape))
@@ -0,0 +1,41 @@
+import random
+import basix
+import numpy as np
+import pytest
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "hexahedron", 2),
+    ("Lagrange", "prism", 2),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 2),
+    ("Raviart-Thomas", "hexahedron", 2),
+    ("Regge", "triangle", 1),
+])
+def test_tabulate_physical(element_name, cell_name, order):
+    random.seed(7)
+    np.random.seed(7)
+    e = basix.create_element(element_name, cell_name, order)
+    tdim = len(basix.topology(e.cell_type)) - 1
+
+    # Use enough points to give several tiles, and a different
+    # Jacobian at each point, as on a non-affine cell
+    ncells = 3
+    npts = 300
+    pts = np.random.random((npts, tdim)) / tdim
+    J = np.random.random((ncells, npts, tdim, tdim)) * 0.2 + np.eye(tdim)
+    detJ = np.linalg.det(J)
+    K = np.linalg.inv(J)
+    cell_info = np.array([random.randrange(2**30) for _ in range(ncells)], dtype=np.uint32)
+
+    tab = e.tabulate_physical(1, pts, J, detJ, K, cell_info)
+    assert tab.shape[:4] == (ncells, tdim + 1, npts, e.dim)
+
+    # Compare with tabulating, transforming and pushing forward
+    # separately
+    ref = e.tabulate_x(1, pts)
+    for c in range(ncells):
+        for d in range(tdim + 1):
+            values = np.array([e.apply_dof_transformation(ref[d, p].copy().flatten(), e.value_size,
+                                                          int(cell_info[c])) for p in range(npts)])
+            values = values.reshape(npts, e.dim, e.value_size)
+            assert np.allclose(tab[c, d], e.map_push_forward(values, J[c], detJ[c], K[c]))
@@ -0,0 +1,22 @@
+import basix
+import numpy as np
+import pytest
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("P", "triangle", 3),
+    ("P", "hexahedron", 2),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 2),
+])
+@pytest.mark.parametrize("num_threads", [2, 3, 8])
+def test_threads(element_name, cell_name, order, num_threads):
+    e = basix.create_element(element_name, cell_name, order)
+    tdim = len(basix.topology(e.cell_type)) - 1
+
+    # Use enough points to give several tiles, with a partial last tile
+    np.random.seed(13)
+    pts = np.random.random((1500, tdim)) / tdim
+
+    serial = e.tabulate(2, pts)
+    parallel = e.tabulate(2, pts, num_threads=num_threads)
+    assert np.array_equal(serial, parallel)
@@ -0,0 +1,44 @@
+import basix
+import numpy as np
+import pytest
+
+
+@pytest.mark.parametrize("element_name, cell_name, order", [
+    ("Lagrange", "interval", 3),
+    ("Lagrange", "triangle", 3),
+    ("Lagrange", "tetrahedron", 2),
+    ("Lagrange", "quadrilateral", 3),
+    ("Lagrange", "hexahedron", 2),
+    ("Lagrange", "prism", 2),
+    ("Lagrange", "pyramid", 2),
+    ("Nedelec 1st kind H(curl)", "tetrahedron", 2),
+])
+def test_reused_workspace(element_name, cell_name, order):
+    e = basix.create_element(element_name, cell_name, order)
+    tdim = len(basix.topology(e.cell_type)) - 1
+
+    # Reuse the workspace for more, fewer and then more points than it
+    # has previously been sized for, including partial tiles
+    w = basix.TabulateWorkspace()
+    np.random.seed(3)
+    for npts in [300, 40, 600, 1]:
+        pts = np.random.random((npts, tdim)) / tdim
+        for nd in [0, 1, 2]:
+            tab = e.tabulate_x(nd, pts)
+            t = np.empty(tab.shape)
+            e.tabulate_into(nd, pts, t, w)
+            assert np.allclose(t, tab)
+
+            layout = basix.LayoutType.valueDofPoint
+            tab = e.tabulate_x(nd, pts, layout=layout)
+            t = np.empty(tab.shape)
+            e.tabulate_into(nd, pts, t, w, layout=layout)
+            assert np.allclose(t, tab)
+
+
+def test_wrong_shape():
+    e = basix.create_element("Lagrange", "triangle", 2)
+    pts = np.random.random((10, 2)) / 2
+    w = basix.TabulateWorkspace()
+    with pytest.raises(RuntimeError):
+        e.tabulate_into(1, pts, np.empty((3, 10, 5, 1)), w)
@@ -0,0 +1,46 @@
+import basix
+import numpy as np
+import pytest
+
+
+@pytest.mark.parametrize("cell_name", ["quadrilateral", "hexahedron"])
+@pytest.mark.parametrize("element_name, order", [
+    ("Lagrange", 1), ("Lagrange", 2), ("Lagrange", 3), ("Lagrange", 4),
+    ("Raviart-Thomas", 1), ("Raviart-Thomas", 2), ("Raviart-Thomas", 3),
+    ("Nedelec 1st kind H(curl)", 1), ("Nedelec 1st kind H(curl)", 2), ("Nedelec 1st kind H(curl)", 3),
+])
+def test_tensor_factors(element_name, cell_name, order):
+    e = basix.create_element(element_name, cell_name, order)
+    celltype = basix.CellType.interval
+    x1d, _ = basix.make_quadrature("default", celltype, order + 2)
+    x1d = x1d[:, 0]
+
+    tdim = len(basix.topology(e.cell_type)) - 1
+    x = [x1d + 0.01 * d for d in range(tdim)]
+    tables, factors = e.tabulate_tensor_factors(1, x)
+    assert factors.shape == (e.dim, e.value_size, tdim)
+
+    # Tensor-product points, with x varying fastest
+    grid = np.meshgrid(*x, indexing="ij")
+    pts = np.array([g.flatten(order="F") for g in grid]).T
+    tab = e.tabulate_x(1, pts)
+
+    npts = [len(xi) for xi in x]
+    for deriv in range(tdim + 1):
+        k = [1 if deriv == d + 1 else 0 for d in range(tdim)]
+        for c in range(e.value_size):
+            values = np.ones((e.dim,) + tuple(npts))
+            for d in range(tdim):
+                shape = [1] * tdim
+                shape[d] = npts[d]
+                f = tables[d][k[d]][:, factors[:, c, d]].T
+                f[factors[:, c, d] == -1] = 0
+                values *= f.reshape((e.dim, ) + tuple(shape))
+            values = values.reshape((e.dim, -1), order="F")
+            assert np.allclose(values.T, tab[deriv, :, :, c])
+
+
+def test_non_tensor_element():
+    e = basix.create_element("DPC", "quadrilateral", 2)
+    with pytest.raises(RuntimeError):
+        e.tabulate_tensor_factors(0, [np.array([0.5]), np.array([0.5])])